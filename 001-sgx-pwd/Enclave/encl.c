@@ -1,6 +1,7 @@
 #include "encl_t.h"
 #include "secret.h"
 #include <string.h>
+#include <sgx_trts.h>
 
 /*
  * NOTE: for demonstration purposes, we hard-code secrets at compile time and
@@ -62,3 +63,37 @@ int ecall_get_secret(int* secret_pt, char* pwd){
     return allowed;
 }
 /* ============================ END SOLUTION ============================ */
+
+/*
+ * RDTSC is not available inside (SGX1) enclaves, so the samples are read from
+ * a counter that an untrusted thread increments; the LFENCEs keep the reads
+ * from being reordered around check_pwd().
+ */
+static inline uint64_t read_counter(volatile uint64_t *counter)
+{
+    uint64_t v;
+
+    asm volatile ("lfence\n\t" : : : "memory");
+    v = *counter;
+    asm volatile ("lfence\n\t" : : : "memory");
+    return v;
+}
+
+int ecall_check_pwd_batch(char *pwd, int n, uint64_t *ts, uint64_t *counter)
+{
+    int i, allowed = 0;
+
+    if (n <= 0 ||
+        !sgx_is_outside_enclave(ts, 2 * (size_t) n * sizeof(uint64_t)) ||
+        !sgx_is_outside_enclave(counter, sizeof(uint64_t)))
+        return -1;
+
+    for (i=0; i < n; i++)
+    {
+        ts[2*i] = read_counter(counter);
+        allowed = check_pwd(pwd);
+        ts[2*i+1] = read_counter(counter);
+    }
+
+    return allowed;
+}
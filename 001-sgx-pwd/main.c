@@ -1,15 +1,23 @@
 /* utility headers */
 #include "debug.h"
 #include <cacheutils.h>
+#include "stats.h"
 
 /* SGX untrusted runtime */
 #include <sgx_urts.h>
+#include "enclave.h"
 #include "Enclave/encl_u.h"
 
 #define NUM_SAMPLES     1000
 #define DELAY           1
 
-uint64_t diff[NUM_SAMPLES];
+/*
+ * Batched mode (-b): BATCH_SIZE samples per ecall, timed inside the enclave
+ * against a counter incremented by an untrusted thread (see
+ * ecall_check_pwd_batch), so EENTER/EEXIT are no longer part of any sample.
+ */
+#define BATCH_SAMPLES   100000
+#define BATCH_SIZE      1000
 
 /* define untrusted OCALL functions here */
 
@@ -38,29 +46,44 @@ char *read_from_user(void)
     }
 }
 
-sgx_enclave_id_t create_enclave(void)
+/* Sample check_pwd(pwd) with batched ecalls; returns the last result. */
+int sample_batched(sgx_enclave_id_t eid, cache_timer_t *timer, char *pwd,
+                   uint64_t *ts, stats_quantile_t *med)
 {
-    sgx_launch_token_t token = {0};
-    int updated = 0;
-    sgx_enclave_id_t eid = -1;
+    int i, j, allowed = 0;
 
-    info_event("Creating enclave...");
-    SGX_ASSERT( sgx_create_enclave( "./Enclave/encl.so", /*debug=*/1,
-                                    &token, &updated, &eid, NULL ) );
+    for (j=0; j < BATCH_SAMPLES; j += BATCH_SIZE)
+    {
+        SGX_ASSERT( ecall_check_pwd_batch(eid, &allowed, pwd, BATCH_SIZE, ts,
+                                          (uint64_t *) &timer->count) );
+        ASSERT(allowed >= 0);
 
-    return eid;
-}
+        for (i=0; i < BATCH_SIZE; i++)
+            stats_quantile_add(med, ts[2*i+1] - ts[2*i]);
+    }
 
-int compare(const void * a, const void * b) {
-   return ( *(uint64_t*)a - *(uint64_t*)b );
+    return allowed;
 }
 
 int main( int argc, char **argv )
 {
-    sgx_enclave_id_t eid = create_enclave();
+    sgx_enclave_id_t eid = enclave_open("./Enclave/encl.so",
+                                        ENCLAVE_DEFAULT_FLAGS);
     int rv = 1, secret = 0;
     char *pwd;
-    int j, tsc1, tsc2, med, allowed = 0;
+    int j, allowed = 0, batched = 0, samples;
+    uint64_t tsc1, tsc2, start, *ts = NULL;
+    stats_quantile_t med;
+    cache_timer_t timer;
+
+    /* usage: ./sgx-pin [-b] */
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+    {
+        batched = 1;
+        ASSERT( !timer_init(&timer, TIMER_THREAD) );
+        ASSERT( (ts = malloc(2 * BATCH_SIZE * sizeof(uint64_t))) );
+        info("batched ecalls; counter thread next to cpu %d", timer.cpu);
+    }
 
     /* Example SGX enclave ecall invocation */
     SGX_ASSERT( ecall_dummy(eid, &rv, 1) );
@@ -69,8 +92,16 @@ int main( int argc, char **argv )
     while ((pwd = read_from_user()) && strcmp(pwd, "q"))
     {
 
-    /* collect execution timing samples */
-    for (j=0; j < NUM_SAMPLES; j++)
+    /* collect execution timing samples; keep a running median (avg may be
+       affected by outliers) */
+    stats_quantile_init(&med, 0.5);
+    start = rdtsc_begin();
+    if (batched)
+    {
+        allowed = sample_batched(eid, &timer, pwd, ts, &med);
+        samples = BATCH_SAMPLES;
+    }
+    else for (j=0, samples=NUM_SAMPLES; j < NUM_SAMPLES; j++)
     {
         tsc1 = rdtsc_begin();
         /* =========================== START SOLUTION =========================== */
@@ -79,8 +110,9 @@ int main( int argc, char **argv )
         /* ============================ END SOLUTION ============================ */
         tsc2 = rdtsc_end();
 
-        diff[j] = tsc2 - tsc1;
+        stats_quantile_add(&med, tsc2 - tsc1);
     }
+    tsc2 = rdtsc_end();
 
 	printf("Return value: %d, Secret: 0x%x\n", allowed, secret);
 
@@ -112,18 +144,24 @@ int main( int argc, char **argv )
         printf("       \\__U_/      \n\n");
     }
     
-    /* compute median over all samples (avg may be affected by outliers) */
-    qsort(diff, NUM_SAMPLES, sizeof(uint64_t), compare);
-    med = diff[NUM_SAMPLES/2];
-    printf("time (med clock cycles): %lu\n", med);
+    printf("time (med %s): %.0f\n", batched ? "counter ticks" : "clock cycles",
+           stats_quantile_get(&med));
+    printf("%d samples at %.0f samples per Gcycle\n", samples,
+           samples / ((tsc2 - start) / 1e9));
 
     free(pwd);
 
     }
 
     /* ---------------------------------------------------------------------- */
+    if (batched)
+    {
+        timer_destroy(&timer);
+        free(ts);
+    }
+
     info_event("destroying SGX enclave");
-    SGX_ASSERT( sgx_destroy_enclave( eid ) );
+    enclave_close( eid );
 
     info("all is well; exiting..");
 	return 0;
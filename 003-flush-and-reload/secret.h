@@ -1 +1,4 @@
 int secret_idx        = 7;
+
+/* streamed byte by byte in the -s mode */
+char secret_buf[]     = "The Magic Words are Squeamish Ossifrage.";
@@ -1,4 +1,5 @@
 #include "secret.h"
+#include "oblivious.h"
 
 volatile char c;
 
@@ -7,3 +8,29 @@ void ecall_secret_lookup(char *array, int len)
     /* Do the secret lookup */
     c = array[(4096*secret_idx) % len];
 }
+
+int ecall_secret_len(void)
+{
+    return sizeof(secret_buf) - 1;
+}
+
+void ecall_secret_stream(char *table, int stride, int i)
+{
+    /* one table lookup for byte i of the secret buffer */
+    c = table[((unsigned char) secret_buf[i]) * stride];
+}
+
+/* hardened lookups: touch every slot, whatever the secret */
+void ecall_secret_lookup_cmov(char *array, int len)
+{
+    int off = (4096*secret_idx) % len;
+
+    c = oblivious_read_cmov(array, len, off, (len % 4096) ? 64 : 4096);
+}
+
+void ecall_secret_lookup_avx2(char *array, int len)
+{
+    int off = (4096*secret_idx) % len;
+
+    c = oblivious_read_avx2(array, len, off, (len % 4096) ? 64 : 4096);
+}
@@ -3,4 +3,15 @@
 
 void ecall_secret_lookup(char *array, int len);
 
+/*
+ * Oblivious variants (see oblivious.h): read every slot of the array (every
+ * line, if len is not a multiple of 4096) and keep the secret one.
+ */
+void ecall_secret_lookup_cmov(char *array, int len);
+void ecall_secret_lookup_avx2(char *array, int len);
+
+/* streaming victim: indexes a 256-entry table with byte i of a secret */
+int ecall_secret_len(void);
+void ecall_secret_stream(char *table, int stride, int i);
+
 #endif
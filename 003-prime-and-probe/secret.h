@@ -0,0 +1 @@
+int secret_idx        = 7;
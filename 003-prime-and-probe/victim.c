@@ -0,0 +1,17 @@
+#include "secret.h"
+
+/*
+ * Unlike 003-flush-and-reload, the lookup table is private to the victim and
+ * holds one 64-byte cache line per entry (cf. an AES T-table).
+ */
+#define TABLE_LEN       0x1000
+#define ENTRY_SIZE      64
+
+char __attribute__((aligned(0x1000))) table[TABLE_LEN] = { 1 };
+volatile char c;
+
+void ecall_secret_lookup(void)
+{
+    /* Do the secret lookup */
+    c = table[(ENTRY_SIZE*secret_idx) % TABLE_LEN];
+}
@@ -0,0 +1,6 @@
+#ifndef VICTIM_H_INC
+#define VICTIM_H_INC
+
+void ecall_secret_lookup(void);
+
+#endif
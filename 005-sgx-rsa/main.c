@@ -1,27 +1,35 @@
 /* utility headers */
 #include "debug.h"
 #include "pf.h"
+#include "pt.h"
 #include "cacheutils.h"
 #include <sys/mman.h>
 
 /* SGX untrusted runtime */
 #include <sgx_urts.h>
+#include "enclave.h"
+#include "mt.h"
 #include "Enclave/encl_u.h"
 
 #define RSA_TEST_VAL    1234
 
-sgx_enclave_id_t create_enclave(void)
-{
-    sgx_launch_token_t token = {0};
-    int updated = 0;
-    sgx_enclave_id_t eid = -1;
+/*
+ * Concurrent decryption (-t K): K pinned threads, each with its own TCS,
+ * call ecall_rsa_decode NUM_DECODES times and count into their own padded
+ * slot. Page-fault tracing itself stays single-threaded: page permissions
+ * are per process, so a page opened for one thread's trace would hide the
+ * accesses of the others.
+ */
+#define NUM_DECODES     10000
 
-    info_event("Creating enclave...");
-    SGX_ASSERT( sgx_create_enclave( "./Enclave/encl.so", /*debug=*/1,
-                                    &token, &updated, &eid, NULL ) );
+typedef struct {
+    sgx_enclave_id_t eid;
+    int cipher;
+    uint64_t decodes;
+    uint64_t errors;
+} __attribute__((aligned(64))) decoder_t;
 
-    return eid;
-}
+decoder_t decoders[MT_MAX_THREADS];
 
 int fault_fired = 0;
 void *sq_pt = NULL, *mul_pt = NULL, *modpow_pt = NULL;
@@ -31,44 +39,28 @@ void *sq_pt = NULL, *mul_pt = NULL, *modpow_pt = NULL;
 // modpow - 1, sq - 2, mul - 3
 int pages[MAX_SIZE], idx=0;
 
-void *prev_page = NULL;
+// only the faulting page is executable at any time (window of 1 page)
+pt_ctl_t ctl;
 /* =========================== END SOLUTION =========================== */
 
-void fault_handler(void *base_adrs)
+void decode(void *arg, int id)
 {
-    /* =========================== START SOLUTION =========================== */
-    // printf("%lx\n", base_adrs);
-
-    if(base_adrs == modpow_pt){
-        pages[idx] = 1;
-
-        // modpow is executed for the 1st time -- mark sq and mul as NON_EXECUTABLE
-        if(prev_page == NULL){
-            mprotect(sq_pt, 0x1000, PROT_NONE);
-            mprotect(mul_pt, 0x1000, PROT_NONE);
-        }
-        else{
-            // mark prev_page as NON_EXECUTABLE
-            mprotect(prev_page, 0x1000, PROT_NONE);
-        }
-    }
-    else if(base_adrs == sq_pt){
-        pages[idx] = 2;
-        
-        // mark prev_page as NON_EXECUTABLE
-        mprotect(prev_page, 0x1000, PROT_NONE);
-    }
-    else if(base_adrs == mul_pt){
-        pages[idx] = 3;
-
-        // mark prev_page as NON_EXECUTABLE
-        mprotect(prev_page, 0x1000, PROT_NONE);
+    decoder_t *d = arg;
+    int plain, i;
+
+    for (i=0; i < NUM_DECODES; i++)
+    {
+        SGX_ASSERT( ecall_rsa_decode(d->eid, &plain, d->cipher) );
+        d->decodes++;
+        d->errors += (plain != RSA_TEST_VAL);
     }
+}
 
-    // mark current page as EXECUTABLE
-    mprotect(base_adrs, 0x1000, PROT_EXEC);
-    idx += 1;
-    prev_page = base_adrs;
+void fault_handler(void *base_adrs)
+{
+    /* =========================== START SOLUTION =========================== */
+    // note down the page, mark it EXECUTABLE and the previous page NON_EXECUTABLE
+    pt_fault(&ctl, base_adrs);
     /* =========================== END SOLUTION =========================== */
 
     fault_fired++;
@@ -76,9 +68,16 @@ void fault_handler(void *base_adrs)
 
 int main( int argc, char **argv )
 {
-    sgx_enclave_id_t eid = create_enclave();
+    sgx_enclave_id_t eid = enclave_open("./Enclave/encl.so",
+                                        ENCLAVE_DEFAULT_FLAGS);
     int rv = 1, secret = 0;
-    int cipher, plain;
+    int cipher, plain, k, nthreads = 0, use_mt = 0;
+    uint64_t decodes = 0, errors = 0;
+    double secs;
+
+    /* -t K: K concurrent decryption threads (0: one per core, see mt.h) */
+    if ((use_mt = (argc > 2 && !strcmp(argv[1], "-t"))))
+        nthreads = atoi(argv[2]);
 
     /* ---------------------------------------------------------------------- */
     info("registering fault handler..");
@@ -97,8 +96,17 @@ int main( int argc, char **argv )
     info("secure enclave encrypted '%d' to '%d'; decrypted '%d'", RSA_TEST_VAL, cipher, plain);
 
     /* =========================== START SOLUTION =========================== */
-    mprotect(modpow_pt, 0x1000, PROT_NONE);
+    pt_init(&ctl, 1, pages, MAX_SIZE);
+    ASSERT(!pt_add(&ctl, modpow_pt, 1, PROT_EXEC));
+    ASSERT(!pt_add(&ctl, sq_pt, 2, PROT_EXEC));
+    ASSERT(!pt_add(&ctl, mul_pt, 3, PROT_EXEC));
+    pt_arm(&ctl);
     SGX_ASSERT( ecall_rsa_decode(eid, &plain, cipher) );
+    pt_disarm(&ctl);
+    pf_trace_dump();
+    if (ctl.refaults)
+        info("%lu fault(s) on open pages; their rights were widened", ctl.refaults);
+    idx = ctl.trace_len;
 
     int rsa_d = 0, mask = 0x8000;
 
@@ -143,8 +151,26 @@ int main( int argc, char **argv )
     printf("\nsecret rsa_d = %d\n", rsa_d);
     /* =========================== END SOLUTION =========================== */
 
+    if (use_mt)
+    {
+        info_event("concurrent decryption");
+        for (k=0; k < MT_MAX_THREADS; k++)
+        {
+            decoders[k].eid = eid;
+            decoders[k].cipher = cipher;
+        }
+        nthreads = mt_run(nthreads, decode, decoders, sizeof(decoder_t), &secs);
+        for (k=0; k < nthreads; k++)
+        {
+            decodes += decoders[k].decodes;
+            errors += decoders[k].errors;
+        }
+        info("%d thread(s): %lu decryptions (%lu wrong) in %.3f s (%.0f/s)",
+             nthreads, decodes, errors, secs, decodes / secs);
+    }
+
     info_event("destroying SGX enclave");
-    SGX_ASSERT( sgx_destroy_enclave( eid ) );
+    enclave_close( eid );
 
     info("all is well; exiting..");
 	return 0;
@@ -0,0 +1,106 @@
+#include "diff.h"
+#include "debug.h"
+#include <stdlib.h>
+
+typedef struct {
+    int a;          /* position in a (deletion) or before which b is inserted */
+    int b;
+} diff_edit_t;
+
+static void diff_add_edit(diff_hunk_t *hunks, int max_hunks, int *nhunks,
+                          int a, int b, int ins)
+{
+    diff_hunk_t *h = (*nhunks > 0 && *nhunks <= max_hunks) ?
+                     &hunks[*nhunks-1] : NULL;
+
+    /* extend the last hunk if no match lies in between */
+    if (h && h->a_pos + h->a_len == a && h->b_pos + h->b_len == b)
+    {
+        h->a_len += !ins;
+        h->b_len += ins;
+        return;
+    }
+
+    if (*nhunks < max_hunks)
+    {
+        h = &hunks[*nhunks];
+        h->a_pos = a;
+        h->b_pos = b;
+        h->a_len = !ins;
+        h->b_len = ins;
+    }
+    (*nhunks)++;
+}
+
+int diff_myers(const int *a, int n, const int *b, int m,
+               diff_hunk_t *hunks, int max_hunks, int *nhunks)
+{
+    int **v, *V, *P, d, k, x, y, D = -1, pk, ins, i;
+    diff_edit_t *edits;
+    char *is_ins;
+
+    *nhunks = 0;
+    ASSERT((v = calloc(DIFF_MAX_D+1, sizeof(int *))));
+
+    /* forward search: v[d][k] is the furthest x on diagonal k = x - y */
+    for (d=0; d <= DIFF_MAX_D && D < 0; d++)
+    {
+        ASSERT((v[d] = malloc((2*d+1) * sizeof(int))));
+        V = v[d] + d;
+        P = d ? v[d-1] + (d-1) : NULL;
+
+        for (k=-d; k <= d; k += 2)
+        {
+            if (!d)
+                x = 0;
+            else if (k == -d || (k != d && P[k-1] < P[k+1]))
+                x = P[k+1];             /* step down: insert b[y] */
+            else
+                x = P[k-1] + 1;         /* step right: delete a[x] */
+            y = x - k;
+
+            while (x < n && y < m && a[x] == b[y])
+                x++, y++;
+            V[k] = x;
+
+            if (x >= n && y >= m)
+            {
+                D = d;
+                break;
+            }
+        }
+    }
+
+    /* backtrack from (n, m), collecting the edits in reverse order */
+    if (D > 0)
+    {
+        ASSERT((edits = malloc(D * sizeof(diff_edit_t))));
+        ASSERT((is_ins = malloc(D)));
+        x = n;
+        y = m;
+        for (d=D; d > 0; d--)
+        {
+            P = v[d-1] + (d-1);
+            k = x - y;
+            ins = (k == -d || (k != d && P[k-1] < P[k+1]));
+            pk = ins ? k+1 : k-1;
+            x = P[pk];
+            y = x - pk;
+            edits[d-1].a = x;
+            edits[d-1].b = y;
+            is_ins[d-1] = ins;
+        }
+
+        for (i=0; i < D; i++)
+            diff_add_edit(hunks, max_hunks, nhunks, edits[i].a, edits[i].b,
+                          is_ins[i]);
+        free(edits);
+        free(is_ins);
+    }
+
+    for (d=0; d <= DIFF_MAX_D && v[d]; d++)
+        free(v[d]);
+    free(v);
+
+    return D;
+}
@@ -0,0 +1,29 @@
+#ifndef DIFF_H_INC
+#define DIFF_H_INC
+
+/*
+ * Shortest edit script between two integer sequences with Myers' O(ND)
+ * algorithm ("An O(ND) Difference Algorithm and Its Variations",
+ * Algorithmica 1986), where D is the number of differences: traces that
+ * mostly agree are aligned in near-linear time. The memory for backtracking
+ * grows with D^2, so the search gives up beyond DIFF_MAX_D differences.
+ */
+#define DIFF_MAX_D          4096
+
+/* a[a_pos..a_pos+a_len) was replaced by b[b_pos..b_pos+b_len) */
+typedef struct {
+    int a_pos;
+    int a_len;
+    int b_pos;
+    int b_len;
+} diff_hunk_t;
+
+/*
+ * Align a[0..n) and b[0..m) and store up to max_hunks hunks of consecutive
+ * edits in hunks[] (*nhunks receives the total number). Returns the edit
+ * distance D (deletions plus insertions), or -1 if D > DIFF_MAX_D.
+ */
+int diff_myers(const int *a, int n, const int *b, int m,
+               diff_hunk_t *hunks, int max_hunks, int *nhunks);
+
+#endif
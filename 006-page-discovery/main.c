@@ -0,0 +1,232 @@
+/* utility headers */
+#include "debug.h"
+#include "pf.h"
+#include "pt.h"
+#include "diff.h"
+#include <dlfcn.h>
+#include <link.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Victims are shared libraries exporting 'void victim_run(int secret)'. All
+ * pages of their loadable segments (.text, .rodata, .data, .bss, GOT, ...)
+ * are traced, with separate windows for code and data pages: one instruction
+ * may need its code page and a data page at the same time.
+ */
+#define CODE_WINDOW         1
+#define DATA_WINDOW         2
+#define MAX_TRACE           100000
+#define MAX_HUNKS           1000
+#define MAX_PRINT_HUNKS     20
+
+typedef void (*victim_run_t)(int secret);
+
+pt_ctl_t code_ctl, data_ctl;
+char *lib_base = NULL;
+int lib_pages = 0, lib_span = 0;
+int trace[2][MAX_TRACE], trace_len[2];
+int *cur_trace = NULL, cur_len = 0;
+diff_hunk_t hunks[MAX_HUNKS];
+pf_record_t records[64];
+
+void fault_handler(void *base_adrs)
+{
+    int id = pt_fault(&code_ctl, base_adrs);
+
+    if (id < 0)
+        id = pt_fault(&data_ctl, base_adrs);
+
+    if (id >= 0 && cur_trace && cur_len < MAX_TRACE)
+        cur_trace[cur_len++] = id;
+}
+
+/* page ids are page offsets from the lowest mapped address of the library */
+int add_segment(void *start, size_t len, int prot)
+{
+    char *p;
+
+    for (p = GET_PFN(start); p < (char *) start + len; p += 0x1000)
+    {
+        /* PT_LOAD segments are sorted by address */
+        if (!lib_base)
+            lib_base = p;
+
+        if (pt_lookup(&code_ctl, p) || pt_lookup(&data_ctl, p))
+            continue;               /* page shared by adjacent segments */
+        if (pt_add((prot & PROT_EXEC) ? &code_ctl : &data_ctl, p,
+                   (p - lib_base) / 0x1000, prot))
+            return -1;
+        lib_pages++;
+        lib_span = (p - lib_base) / 0x1000 + 1;
+    }
+    return 0;
+}
+
+int find_segments(struct dl_phdr_info *info, size_t size, void *data)
+{
+    const ElfW(Phdr) *ph;
+    char *start, *relro = NULL;
+    size_t relro_len = 0;
+    int i, prot;
+
+    if (!info->dlpi_name || !strstr(info->dlpi_name, (char *) data))
+        return 0;
+
+    for (i=0; i < info->dlpi_phnum; i++)
+        if (info->dlpi_phdr[i].p_type == PT_GNU_RELRO)
+        {
+            relro = (char *) info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+            relro_len = info->dlpi_phdr[i].p_memsz;
+        }
+
+    for (i=0; i < info->dlpi_phnum; i++)
+    {
+        ph = &info->dlpi_phdr[i];
+        if (ph->p_type != PT_LOAD)
+            continue;
+
+        start = (char *) info->dlpi_addr + ph->p_vaddr;
+        prot = ((ph->p_flags & PF_R) ? PROT_READ : 0) |
+               ((ph->p_flags & PF_W) ? PROT_WRITE : 0) |
+               ((ph->p_flags & PF_X) ? PROT_EXEC : 0);
+
+        /* the read-only part after relocation (GOT) comes first */
+        if (relro && start <= relro && relro < start + ph->p_memsz)
+        {
+            ASSERT(!add_segment(start, relro + relro_len - start, PROT_READ));
+            ASSERT(!add_segment(relro + relro_len,
+                   start + ph->p_memsz - (relro + relro_len), prot));
+            continue;
+        }
+        ASSERT(!add_segment(start, ph->p_memsz, prot));
+    }
+
+    return 1;
+}
+
+void run_traced(victim_run_t run, int secret, int t)
+{
+    cur_trace = trace[t];
+    cur_len = 0;
+
+    pt_arm(&code_ctl);
+    pt_arm(&data_ctl);
+    run(secret);
+    pt_disarm(&code_ctl);
+    pt_disarm(&data_ctl);
+
+    trace_len[t] = cur_len;
+    cur_trace = NULL;
+    while (pf_trace_drain(records, 64));
+}
+
+/* Describe a page by its access rights and the nearest exported symbol. */
+const char *page_name(int id)
+{
+    static char name[128];
+    char *p = lib_base + id * 0x1000;
+    pt_entry_t *e = pt_lookup(&code_ctl, p);
+    Dl_info dli;
+
+    if (!e)
+        e = pt_lookup(&data_ctl, p);
+    snprintf(name, sizeof(name), "%c%c%c%s%s",
+             (e->prot & PROT_READ) ? 'r' : '-',
+             (e->prot & PROT_WRITE) ? 'w' : '-',
+             (e->prot & PROT_EXEC) ? 'x' : '-',
+             (dladdr(p, &dli) && dli.dli_sname) ? ", near " : "",
+             (dladdr(p, &dli) && dli.dli_sname) ? dli.dli_sname : "");
+    return name;
+}
+
+void print_seq(const int *s, int len)
+{
+    int i;
+
+    for (i=0; i < len; i++)
+        printf("%s%d", i ? " " : "", s[i]);
+}
+
+int main( int argc, char **argv )
+{
+    int secret[2], D, nhunks, i, j, t, *only_in[2];
+    victim_run_t run;
+    void *lib;
+
+    if (argc < 4)
+    {
+        printf("usage: %s <victim.so> <secret0> <secret1>\n", argv[0]);
+        return 1;
+    }
+    secret[0] = atoi(argv[2]);
+    secret[1] = atoi(argv[3]);
+
+    /* ---------------------------------------------------------------------- */
+    info("loading '%s'..", argv[1]);
+    ASSERT((lib = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL)));
+    ASSERT((run = (victim_run_t) dlsym(lib, "victim_run")));
+
+    pt_init(&code_ctl, CODE_WINDOW, NULL, 0);
+    pt_init(&data_ctl, DATA_WINDOW, NULL, 0);
+    ASSERT(dl_iterate_phdr(find_segments, strrchr(argv[1], '/') ?
+                           strrchr(argv[1], '/') + 1 : argv[1]));
+    info("tracing %d pages (%d code, %d data) from %p", lib_pages,
+         code_ctl.npages, data_ctl.npages, lib_base);
+
+    info("registering fault handler..");
+    register_fault_handler(fault_handler);
+
+    /* ---------------------------------------------------------------------- */
+    info_event("collecting page-access traces");
+    run(secret[0]);     /* warm up */
+    for (t=0; t < 2; t++)
+    {
+        run_traced(run, secret[t], t);
+        info("secret=%d: %d page faults%s", secret[t], trace_len[t],
+             (trace_len[t] == MAX_TRACE) ? " (truncated)" : "");
+    }
+
+    /* ---------------------------------------------------------------------- */
+    info_event("aligning traces");
+    D = diff_myers(trace[0], trace_len[0], trace[1], trace_len[1],
+                   hunks, MAX_HUNKS, &nhunks);
+    if (D < 0)
+    {
+        info("traces differ in more than %d positions", DIFF_MAX_D);
+        return 1;
+    }
+    info("edit distance %d in %d hunk(s)", D, nhunks);
+
+    for (i=0; i < nhunks && i < MAX_PRINT_HUNKS; i++)
+    {
+        printf("  @%d/%d: -[", hunks[i].a_pos, hunks[i].b_pos);
+        print_seq(&trace[0][hunks[i].a_pos], hunks[i].a_len);
+        printf("] +[");
+        print_seq(&trace[1][hunks[i].b_pos], hunks[i].b_len);
+        printf("]\n");
+    }
+    if (nhunks > MAX_PRINT_HUNKS)
+        printf("  ... (%d more)\n", nhunks - MAX_PRINT_HUNKS);
+
+    /* ---------------------------------------------------------------------- */
+    info_event("secret-dependent pages");
+    ASSERT((only_in[0] = calloc(lib_span, sizeof(int))));
+    ASSERT((only_in[1] = calloc(lib_span, sizeof(int))));
+    for (i=0; i < nhunks && i < MAX_HUNKS; i++)
+    {
+        for (j=0; j < hunks[i].a_len; j++)
+            only_in[0][trace[0][hunks[i].a_pos + j]]++;
+        for (j=0; j < hunks[i].b_len; j++)
+            only_in[1][trace[1][hunks[i].b_pos + j]]++;
+    }
+
+    for (i=0; i < lib_span; i++)
+        if (only_in[0][i] || only_in[1][i])
+            info("page %d (+%#x, %s): %d accesses only with secret=%d, %d only with secret=%d",
+                 i, i * 0x1000, page_name(i), only_in[0][i], secret[0],
+                 only_in[1][i], secret[1]);
+
+    info("all is well; exiting..");
+    return 0;
+}
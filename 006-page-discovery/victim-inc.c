@@ -0,0 +1,8 @@
+#include "../002-inc-secret/victim.h"
+
+/* 002-inc-secret: both ecalls, with the secret input as argument */
+void victim_run(int secret)
+{
+    ecall_inc_secret(secret);
+    ecall_inc_secret_maccess(secret);
+}
@@ -0,0 +1,10 @@
+#include "../005-rsa/victim.h"
+
+/* 005-rsa: one decryption with the secret as private exponent */
+extern int rsa_d;
+
+void victim_run(int secret)
+{
+    rsa_d = secret;
+    ecall_rsa_decode(21921);
+}
@@ -0,0 +1,89 @@
+/*
+ * Cost of the oblivious table reads (see oblivious.h) against the leaky
+ * direct read array[off], in cycles per lookup, as the array grows from 10
+ * to 4096 pages. Slots are pages (the 003 victims with a page-multiple len)
+ * or cache lines (any other len). Every lookup uses a fresh random slot,
+ * and every result is checked against the direct read.
+ */
+#include "debug.h"
+#include "cacheutils.h"
+#include "oblivious.h"
+#include "stats.h"
+#include "xorshift.h"
+#include <sys/mman.h>
+
+#define NUM_LOOKUPS         200
+#define PAGE_SIZE           0x1000
+
+enum { LEAKY, CMOV, AVX2 };
+const char *names[] = { "leaky", "cmov", "avx2" };
+
+static inline int lookup(int kind, char *array, size_t len, size_t off, size_t stride)
+{
+    switch (kind)
+    {
+        case CMOV:
+            return oblivious_read_cmov(array, len, off, stride);
+        case AVX2:
+            return oblivious_read_avx2(array, len, off, stride);
+        default:
+            return (unsigned char) *(volatile char *) (array + off);
+    }
+}
+
+double run(int kind, char *array, size_t len, size_t stride)
+{
+    stats_quantile_t median;
+    uint64_t tsc1, tsc2, x = xorshift_seed(), off;
+    int i, r;
+
+    stats_quantile_init(&median, 0.5);
+    for (i=0; i < NUM_LOOKUPS; i++)
+    {
+        off = (xorshift(&x) % (len / stride)) * stride;
+
+        tsc1 = rdtsc_begin();
+        r = lookup(kind, array, len, off, stride);
+        tsc2 = rdtsc_end();
+        ASSERT(r == (unsigned char) array[off]);
+        stats_quantile_add(&median, tsc2 - tsc1);
+    }
+
+    return stats_quantile_get(&median);
+}
+
+int main( int argc, char **argv )
+{
+    int pages[] = { 10, 100, 1000, 4096 }, i, k, s, nkinds;
+    size_t strides[] = { PAGE_SIZE, 64 }, len, j;
+    double cyc[3];
+    char *array;
+
+    nkinds = oblivious_has_avx2() ? 3 : 2;
+    if (nkinds < 3)
+        info("WARNING: no AVX2; skipping the avx2 variant");
+
+    printf("%6s %6s %10s %10s %10s %8s %8s\n", "pages", "stride", "leaky",
+           "cmov", "avx2", "x cmov", "x avx2");
+    for (i=0; i < 4; i++)
+    {
+        len = (size_t) pages[i]*PAGE_SIZE;
+        array = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        ASSERT(array != MAP_FAILED);
+        for (j=0; j < len; j++)
+            array[j] = j*7 + (j >> 12);
+
+        for (s=0; s < 2; s++)
+        {
+            for (k=0, cyc[AVX2]=0; k < nkinds; k++)
+                cyc[k] = run(k, array, len, strides[s]);
+            printf("%6d %6zu %10.0f %10.0f %10.0f %8.1f %8.1f\n", pages[i],
+                   strides[s], cyc[LEAKY], cyc[CMOV], cyc[AVX2],
+                   cyc[CMOV] / cyc[LEAKY], cyc[AVX2] / cyc[LEAKY]);
+        }
+        munmap(array, len);
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Virtual-to-physical translation cost (see phys.h), in cycles per page:
+ * one pread() of /proc/self/pagemap per page ("naive"), a batched
+ * phys_query() with an empty translation cache ("cold") and the same query
+ * repeated ("warm"). Ranges larger than the translation cache keep missing
+ * in it. Needs root for the physical addresses; the timings are reported
+ * either way.
+ */
+#include "debug.h"
+#include "cacheutils.h"
+#include "phys.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define NUM_ROUNDS          10
+#define MAX_PAGES           65536
+
+phys_info_t info[MAX_PAGES];
+
+void run(int npages)
+{
+    size_t len = (size_t) npages*PHYS_PAGE_SIZE;
+    uint64_t tsc, naive = 0, cold = 0, warm = 0, e;
+    int fd, r, i, known = 0;
+    char *buf;
+
+    buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    ASSERT(buf != MAP_FAILED);
+    ASSERT((fd = open("/proc/self/pagemap", O_RDONLY)) >= 0);
+
+    for (r=0; r < NUM_ROUNDS; r++)
+    {
+        tsc = rdtsc_begin();
+        for (i=0; i < npages; i++)
+            ASSERT(pread(fd, &e, sizeof(e), ((uint64_t) buf/PHYS_PAGE_SIZE + i)*
+                         sizeof(e)) == sizeof(e));
+        naive += rdtsc_end() - tsc;
+
+        phys_invalidate();
+        tsc = rdtsc_begin();
+        ASSERT(phys_query(buf, len, PHYS_PAGE_SIZE, info, npages) == npages);
+        cold += rdtsc_end() - tsc;
+
+        tsc = rdtsc_begin();
+        ASSERT(phys_query(buf, len, PHYS_PAGE_SIZE, info, npages) == npages);
+        warm += rdtsc_end() - tsc;
+    }
+    for (i=0; i < npages; i++)
+        known += (info[i].pa != 0);
+
+    printf("%8d %10lu %10lu %10lu %8d\n", npages,
+           naive / ((uint64_t) NUM_ROUNDS*npages),
+           cold / ((uint64_t) NUM_ROUNDS*npages),
+           warm / ((uint64_t) NUM_ROUNDS*npages), known);
+    close(fd);
+    munmap(buf, len);
+}
+
+int main( int argc, char **argv )
+{
+    const phys_geom_t *g = phys_geometry();
+    int pages[] = { 64, 1024, 4096, 65536 }, i;
+
+    if (phys_init() < 0)
+        info("WARNING: no physical addresses (not root?)");
+    info("L1 %d sets, L2 %d sets, LLC %d sets in %d slice(s), slice hash %s",
+         g->l1_sets, g->l2_sets, g->llc_sets, g->llc_slices,
+         g->slice_hash ? "known" : "unknown");
+
+    printf("%8s %10s %10s %10s %8s\n", "pages", "naive", "cold", "warm", "known");
+    for (i=0; i < 4; i++)
+        run(pages[i]);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Probe latency and noise vs. probe-memory backing: page-strided probe
+ * arrays of 256 and 4096 slots on 4 KiB pages and on 2 MiB pages (see
+ * probe.h), with sequential and randomized slot layout. Each round reloads
+ * all slots once after caching them ("hit") and once after flushing them
+ * ("miss"), in slot order, as the attacks do. "fp" is the fraction of
+ * flushed slots classified as hits, "fn" the fraction of cached slots
+ * classified as misses, using a threshold calibrated on the same buffer.
+ */
+#include "debug.h"
+#include "cacheutils.h"
+#include "probe.h"
+#include "stats.h"
+#include <stdlib.h>
+
+#define NUM_ROUNDS          50
+#define MAX_SLOTS           4096
+#define STRIDE              0x1000
+
+int lat[MAX_SLOTS];
+
+void run(int nslots, int flags)
+{
+    stats_quantile_t hit_med, miss_med;
+    uint64_t fp = 0, fn = 0;
+    cache_calib_t calib;
+    probe_buf_t p;
+    int r, k;
+
+    ASSERT(!probe_alloc(&p, nslots, STRIDE, flags));
+    calibrate_threshold(&calib, p.slot[0]);
+    stats_quantile_init(&hit_med, 0.5);
+    stats_quantile_init(&miss_med, 0.5);
+
+    for (r=0; r < NUM_ROUNDS; r++)
+    {
+        for (k=0; k < nslots; k++)
+            *(volatile char *) p.slot[k];
+        reload_batch(p.slot, lat, nslots);
+        for (k=0; k < nslots; k++)
+        {
+            stats_quantile_add(&hit_med, lat[k]);
+            fn += !cache_hit(&calib, lat[k]);
+        }
+
+        flush_batch(p.slot, nslots);
+        reload_batch(p.slot, lat, nslots);
+        for (k=0; k < nslots; k++)
+        {
+            stats_quantile_add(&miss_med, lat[k]);
+            fp += cache_hit(&calib, lat[k]);
+        }
+    }
+
+    printf("%6d %-8s %-5s %8zu %8.0f %8.0f %8.4f %8.4f\n", nslots,
+           probe_backing_name(&p), (flags & PROBE_RANDOM) ? "rand" : "seq",
+           probe_huge_kb(&p), stats_quantile_get(&hit_med),
+           stats_quantile_get(&miss_med),
+           (double) fp / (NUM_ROUNDS * nslots),
+           (double) fn / (NUM_ROUNDS * nslots));
+    probe_free(&p);
+}
+
+int main( int argc, char **argv )
+{
+    int slots[] = { 256, 4096 }, i;
+
+    printf("%6s %-8s %-5s %8s %8s %8s %8s %8s\n", "slots", "backing",
+           "order", "hugeKB", "hit", "miss", "fp", "fn");
+    for (i=0; i < 2; i++)
+    {
+        run(slots[i], 0);
+        run(slots[i], PROBE_RANDOM);
+        run(slots[i], PROBE_HUGE);
+        run(slots[i], PROBE_HUGE | PROBE_RANDOM);
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Side-by-side benchmark of the Flush+Reload and Flush+Flush probe primitives
+ * of cacheutils.h: cost of one full attack round (resetting and probing all
+ * slots), and how often the slot touched by a simulated victim is classified
+ * as a hit (true positives) versus any of the untouched slots (false
+ * positives).
+ */
+#include "debug.h"
+#include "cacheutils.h"
+
+#define NUM_ROUNDS          10000
+#define MAX_SLOTS           256
+#define SLOT_SIZE           0x1000
+
+char __attribute__((aligned(0x1000))) array[MAX_SLOTS*SLOT_SIZE];
+void *slot_adrs[MAX_SLOTS];
+int lat[MAX_SLOTS];
+
+enum { MODE_RELOAD, MODE_RELOAD_BATCH, MODE_FLUSH_FLUSH };
+const char *mode_name[] = { "flush+reload", "flush+reload (batch)", "flush+flush" };
+
+void run(int mode, int num_slots, cache_calib_t *calib)
+{
+    uint64_t tsc1, cycles = 0;
+    int i, j, victim, tp = 0, fp = 0;
+
+    for (j=0; j < num_slots; j++)
+        flush(slot_adrs[j]);
+
+    for (i=0; i < NUM_ROUNDS; i++)
+    {
+        victim = rand() % num_slots;
+        *(volatile char *) slot_adrs[victim];
+
+        tsc1 = rdtsc_begin();
+        switch (mode)
+        {
+            case MODE_RELOAD:
+                for (j=0; j < num_slots; j++)
+                    lat[j] = reload(slot_adrs[j]);
+                for (j=0; j < num_slots; j++)
+                    flush(slot_adrs[j]);
+                break;
+
+            case MODE_RELOAD_BATCH:
+                reload_batch(slot_adrs, lat, num_slots);
+                for (j=0; j < num_slots; j++)
+                    flush(slot_adrs[j]);
+                break;
+
+            case MODE_FLUSH_FLUSH:
+                for (j=0; j < num_slots; j++)
+                    lat[j] = flush_flush(slot_adrs[j]);
+                break;
+        }
+        cycles += rdtsc_end() - tsc1;
+
+        for (j=0; j < num_slots; j++)
+            if (j == victim)
+                tp += cache_hit(calib, lat[j]);
+            else
+                fp += cache_hit(calib, lat[j]);
+    }
+
+    printf("%-22s %5d %14lu %12.1f %9.2f%% %9.2f%%\n", mode_name[mode],
+           num_slots, cycles / NUM_ROUNDS,
+           (double) cycles / NUM_ROUNDS / num_slots,
+           100.0 * tp / NUM_ROUNDS,
+           100.0 * fp / ((uint64_t) NUM_ROUNDS * (num_slots-1)));
+}
+
+int main( int argc, char **argv )
+{
+    cache_calib_t fr_calib, ff_calib;
+    int i, j;
+    int slots[] = { 10, MAX_SLOTS };
+
+    for (i=0; i < sizeof(array); i++)
+        array[i] = 0x00;
+    for (j=0; j < MAX_SLOTS; j++)
+        slot_adrs[j] = &array[j*SLOT_SIZE];
+
+    calibrate_threshold(&fr_calib, slot_adrs[0]);
+    calibrate_threshold_ff(&ff_calib, slot_adrs[0]);
+    info("flush+reload: hit=%d miss=%d threshold=%d error=%.4f",
+         fr_calib.hit_med, fr_calib.miss_med, fr_calib.threshold,
+         fr_calib.error_rate);
+    info("flush+flush:  hit=%d miss=%d threshold=%d error=%.4f",
+         ff_calib.hit_med, ff_calib.miss_med, ff_calib.threshold,
+         ff_calib.error_rate);
+
+    printf("\n%-22s %5s %14s %12s %10s %10s\n", "primitive", "slots",
+           "cycles/round", "cycles/slot", "true pos", "false pos");
+    for (i=0; i < sizeof(slots)/sizeof(slots[0]); i++)
+    {
+        run(MODE_RELOAD, slots[i], &fr_calib);
+        run(MODE_RELOAD_BATCH, slots[i], &fr_calib);
+        run(MODE_FLUSH_FLUSH, slots[i], &ff_calib);
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Per-fault cost of the page-transition controller (pt.c) as a function of
+ * the number of traced pages: a data buffer of N traced pages is accessed in
+ * a pseudo-random page order with a window of 1, so every access faults.
+ * Also reports the cost of the hash lookup alone.
+ */
+#include "debug.h"
+#include "pf.h"
+#include "pt.h"
+#include "cacheutils.h"
+#include <sys/mman.h>
+
+#define NUM_FAULTS          20000
+#define NUM_LOOKUPS         1000000
+
+int sizes[] = { 3, 24, 96, 1000 };
+int trace[NUM_FAULTS];
+pt_ctl_t ctl;
+
+void fault_handler(void *base_adrs)
+{
+    ASSERT(pt_fault(&ctl, base_adrs) >= 0);
+}
+
+int main( int argc, char **argv )
+{
+    uint64_t tsc1, tsc2, fault_cyc, lookup_cyc;
+    volatile char *buf;
+    int s, i, npages, page = 0;
+
+    register_fault_handler(fault_handler);
+
+    printf("%-8s %10s %12s %12s\n", "pages", "faults", "cyc/fault",
+           "cyc/lookup");
+    for (s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+    {
+        npages = sizes[s];
+        buf = mmap(NULL, (size_t) npages * 0x1000, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ASSERT(buf != MAP_FAILED);
+
+        pt_init(&ctl, 1, trace, NUM_FAULTS);
+        for (i=0; i < npages; i++)
+            ASSERT(!pt_add(&ctl, (char *) buf + i*0x1000, i, PROT_READ));
+        pt_arm(&ctl);
+
+        /* consecutive accesses always hit a different page */
+        tsc1 = rdtsc_begin();
+        for (i=0; i < NUM_FAULTS; i++)
+        {
+            page = (page + 1 + i % (npages-1)) % npages;
+            (void) buf[page * 0x1000];
+        }
+        tsc2 = rdtsc_end();
+        fault_cyc = (tsc2 - tsc1) / NUM_FAULTS;
+        pt_disarm(&ctl);
+
+        tsc1 = rdtsc_begin();
+        for (i=0; i < NUM_LOOKUPS; i++)
+            ASSERT(pt_lookup(&ctl, (char *) buf + (i % npages)*0x1000));
+        tsc2 = rdtsc_end();
+        lookup_cyc = (tsc2 - tsc1) / NUM_LOOKUPS;
+
+        printf("%-8d %10d %12lu %12lu\n", npages, ctl.trace_len, fault_cyc,
+               lookup_cyc);
+        munmap((void *) buf, (size_t) npages * 0x1000);
+    }
+
+    return 0;
+}
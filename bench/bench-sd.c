@@ -0,0 +1,67 @@
+/*
+ * Cost of fault-free write tracking (sd.c) as a function of the number of
+ * tracked pages: median cycles to reset the written state, and to scan the
+ * whole range after every 8th page was written. For comparison, trapping a
+ * single write with a page fault costs on the order of 10^4 cycles
+ * (bench-pf).
+ */
+#include "debug.h"
+#include "sd.h"
+#include "stats.h"
+#include "cacheutils.h"
+#include <sys/mman.h>
+
+#define NUM_ROUNDS          200
+#define STRIDE              8
+
+int sizes[] = { 1, 64, 1024, 4096, 16384 };
+
+int main( int argc, char **argv )
+{
+    stats_quantile_t clear, scan;
+    sd_tracker_t sd;
+    uint64_t tsc1, tsc2;
+    char *buf;
+    int s, i, r, npages, written = 0;
+
+    printf("%-8s %10s %10s %10s %12s\n", "pages", "written", "clear",
+           "scan", "scan/page");
+    for (s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+    {
+        npages = sizes[s];
+        buf = mmap(NULL, (size_t) npages * SD_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ASSERT(buf != MAP_FAILED);
+        ASSERT(!sd_init(&sd, buf, (size_t) npages * SD_PAGE_SIZE));
+        if (!s)
+            info("mode: %s", (sd.mode == SD_MODE_SOFTDIRTY) ? "soft-dirty"
+                                                            : "PAGEMAP_SCAN");
+
+        stats_quantile_init(&clear, 0.5);
+        stats_quantile_init(&scan, 0.5);
+        for (r=0; r < NUM_ROUNDS; r++)
+        {
+            tsc1 = rdtsc_begin();
+            sd_clear(&sd);
+            tsc2 = rdtsc_end();
+            stats_quantile_add(&clear, tsc2 - tsc1);
+
+            for (i=0; i < npages; i += STRIDE)
+                buf[(size_t) i * SD_PAGE_SIZE] = r;
+
+            tsc1 = rdtsc_begin();
+            written = sd_scan(&sd, NULL);
+            tsc2 = rdtsc_end();
+            stats_quantile_add(&scan, tsc2 - tsc1);
+            ASSERT(written == (npages + STRIDE-1) / STRIDE);
+        }
+
+        printf("%-8d %10d %10.0f %10.0f %12.1f\n", npages, written,
+               stats_quantile_get(&clear), stats_quantile_get(&scan),
+               stats_quantile_get(&scan) / npages);
+        sd_destroy(&sd);
+        munmap(buf, (size_t) npages * SD_PAGE_SIZE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Cost of single-stepping (ss.c): a 16-bit square-and-multiply modpow on its
+ * own code page is stepped for NUM_DECRYPTIONS calls. Every call enters the
+ * protected page once (one page fault, which starts stepping) and leaves the
+ * range on return (which stops it). Reports instructions per call and the
+ * cycles per call with and without stepping.
+ */
+#include "debug.h"
+#include "pf.h"
+#include "ss.h"
+#include "cacheutils.h"
+#include <sys/mman.h>
+
+#define NUM_DECRYPTIONS     2000
+#define VICTIM              __attribute__((section(".text.bench_ss"), noinline))
+
+/* the victim code gets a 4 KiB page of its own, from modpow to victim_end */
+VICTIM __attribute__((aligned(0x1000)))
+long long modpow(long long a, long long b, long long n)
+{
+    long long res = 1;
+    uint16_t mask = 0x8000;
+    int i;
+
+    for (i=15; i >= 0; i--)
+    {
+        res = (res * res) % n;
+        if (b & mask)
+            res = (res * a) % n;
+        mask = mask >> 1;
+    }
+    return res;
+}
+
+VICTIM __attribute__((aligned(0x1000)))
+void victim_end(void) {}
+
+void *victim_page = (void *) modpow;
+
+void fault_handler(void *base_adrs)
+{
+    ASSERT(base_adrs == victim_page);
+    pf_protect(base_adrs, PROT_READ | PROT_EXEC);
+    ASSERT(!ss_start());
+}
+
+uint64_t run(int step, uint64_t *steps)
+{
+    uint64_t tsc1, tsc2;
+    int i;
+
+    *steps = 0;
+    tsc1 = rdtsc_begin();
+    for (i=0; i < NUM_DECRYPTIONS; i++)
+    {
+        if (step)
+            pf_protect(victim_page, PROT_NONE);
+        modpow(4422, 26383, 57677);
+        *steps += ss_reset();
+    }
+    tsc2 = rdtsc_end();
+
+    return (tsc2 - tsc1) / NUM_DECRYPTIONS;
+}
+
+int main( int argc, char **argv )
+{
+    uint64_t plain, stepped, steps, dummy;
+
+    register_fault_handler(fault_handler);
+    ss_init();
+    ss_arm(modpow, victim_end);
+
+    plain = run(0, &dummy);
+    stepped = run(1, &steps);
+    ss_disarm();
+
+    printf("%-12s %12s %12s %12s\n", "decryptions", "instr/call",
+           "cyc/call", "cyc/step");
+    printf("%-12d %12lu %12lu %12lu\n", NUM_DECRYPTIONS,
+           steps / NUM_DECRYPTIONS, stepped,
+           (stepped - plain) / (steps / NUM_DECRYPTIONS));
+    info("without stepping: %lu cycles/call", plain);
+
+    return 0;
+}
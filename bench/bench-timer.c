@@ -0,0 +1,62 @@
+/*
+ * Compares the timer backends of cacheutils.h: calibrated overhead of an
+ * empty measurement, and the median and spread (10th to 90th percentile)
+ * of timing a short fixed workload with the overhead subtracted.
+ */
+#include "debug.h"
+#include "cacheutils.h"
+
+#define NUM_ROUNDS          100000
+
+int hist[CALIB_BINS];
+
+void workload(void)
+{
+    volatile int i;
+    for (i=0; i < 100; i++);
+}
+
+int hist_quantile(double q)
+{
+    int i, sum = 0;
+
+    for (i=0; i < CALIB_BINS; i++)
+        if ((sum += hist[i]) > q*NUM_ROUNDS)
+            return i;
+    return CALIB_BINS-1;
+}
+
+int main( int argc, char **argv )
+{
+    cache_timer_t timer;
+    uint64_t t1, t2, lat;
+    int kind, i;
+
+    printf("%-8s %10s %10s %10s %10s\n", "timer", "overhead", "median",
+           "p10", "p90");
+    for (kind=0; kind < TIMER_NUM; kind++)
+    {
+        if (timer_init(&timer, kind))
+        {
+            printf("%-8s %10s\n", timer_names[kind], "n/a");
+            continue;
+        }
+
+        memset(hist, 0, sizeof(hist));
+        for (i=0; i < NUM_ROUNDS; i++)
+        {
+            t1 = timer_begin(&timer);
+            workload();
+            t2 = timer_end(&timer);
+            lat = timer_elapsed(&timer, t1, t2);
+            hist[CALIB_BIN(lat)]++;
+        }
+        timer_destroy(&timer);
+
+        printf("%-8s %10lu %10d %10d %10d\n", timer_names[kind],
+               timer.overhead, hist_quantile(0.5), hist_quantile(0.1),
+               hist_quantile(0.9));
+    }
+
+    return 0;
+}
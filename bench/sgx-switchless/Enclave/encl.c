@@ -0,0 +1,12 @@
+#include "encl_t.h"
+#include <sgx_trts.h>
+
+int ecall_nop(int i)
+{
+    return i;
+}
+
+int ecall_nop_switchless(int i)
+{
+    return i;
+}
@@ -0,0 +1,64 @@
+/*
+ * ECALL transition cost: an empty ECALL through EENTER/EEXIT vs. the same
+ * ECALL through the switchless request queue, served by a trusted worker
+ * thread that stays inside the enclave. Reports the median per-call latency
+ * and the single-caller throughput of both paths.
+ *
+ * The trusted worker busy-waits for requests, so the switchless path only
+ * pays off with a spare core; on a single CPU it falls back to ordinary
+ * ECALLs after the SDK's retry budget and is slower than the plain path.
+ */
+#include "debug.h"
+#include "cacheutils.h"
+#include "stats.h"
+#include "switchless.h"
+#include "enclave.h"
+
+#include <sgx_urts.h>
+#include "Enclave/encl_u.h"
+
+#define NUM_CALLS           100000
+#define NUM_WARMUP          1000
+
+typedef sgx_status_t (*ecall_nop_t)(sgx_enclave_id_t, int *, int);
+
+sgx_enclave_id_t eid = 0;
+
+void run(const char *name, ecall_nop_t ecall)
+{
+    stats_quantile_t median;
+    uint64_t tsc1, tsc2, start, total;
+    int i, rv;
+
+    for (i=0; i < NUM_WARMUP; i++)
+        SGX_ASSERT( ecall(eid, &rv, i) );
+
+    stats_quantile_init(&median, 0.5);
+    start = rdtsc_begin();
+    for (i=0; i < NUM_CALLS; i++)
+    {
+        tsc1 = rdtsc_begin();
+        SGX_ASSERT( ecall(eid, &rv, i) );
+        tsc2 = rdtsc_end();
+        stats_quantile_add(&median, tsc2 - tsc1);
+    }
+    total = rdtsc_end() - start;
+
+    printf("%-12s %10.0f %10lu %12.0f\n", name, stats_quantile_get(&median),
+           total / NUM_CALLS, NUM_CALLS / (total / 1e9));
+}
+
+int main( int argc, char **argv )
+{
+    info("%d trusted worker(s)", SWITCHLESS_TWORKERS);
+    eid = enclave_open("./Enclave/encl.so", ENCLAVE_SWITCHLESS);
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+        info("WARNING: single CPU; the trusted worker competes with the caller");
+
+    printf("%-12s %10s %10s %12s\n", "ecall", "median", "mean", "calls/Gcyc");
+    run("regular", ecall_nop);
+    run("switchless", ecall_nop_switchless);
+
+    enclave_close( eid );
+    return 0;
+}
@@ -1,11 +1,18 @@
 #ifndef CACHE_UTILS_H_INC
 #define CACHE_UTILS_H_INC
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
 /*
  * Code adapted from
  * https://github.com/IAIK/flush_flush/blob/master/sc/cacheutils.h
  */
-uint64_t rdtsc_begin( void )
+static inline uint64_t rdtsc_begin( void )
 {
   uint64_t begin;
   uint32_t a, d;
@@ -25,7 +32,7 @@ uint64_t rdtsc_begin( void )
   return begin;
 }
 
-uint64_t rdtsc_end( void )
+static inline uint64_t rdtsc_end( void )
 {
   uint64_t end;
   uint32_t a, d;
@@ -50,7 +57,7 @@ uint64_t rdtsc_end( void )
  * resolution, low noise, L3 cache side-channel attack." 23rd USENIX Security
  * Symposium (USENIX Security 14). 2014.
  */
-int reload( void * adrs)
+static inline int reload( void * adrs)
 {
     volatile unsigned long time;
 
@@ -71,7 +78,69 @@ int reload( void * adrs)
     return (int) time;
 }
 
-void flush(void* p)
+/*
+ * Batched variant of reload(): times the accesses to n addresses inside a
+ * single serialized region and writes the latency of adrs[i] into lat[i].
+ * Consecutive probes share their timestamps, so each probe only pays for one
+ * lfence+rdtsc pair instead of the full mfence/lfence/rdtsc sequence above.
+ */
+#define RELOAD_BATCH_BEGIN                                              \
+    "mfence\n\t"                                                        \
+    "lfence\n\t"                                                        \
+    "rdtsc\n\t"                                                         \
+    "lfence\n\t"                                                        \
+    "movl %%eax, %%r8d\n\t"
+
+#define RELOAD_BATCH_STEP                                               \
+    "movq (%0), %%rcx\n\t"                                              \
+    "movl (%%rcx), %%eax\n\t"                                           \
+    "lfence\n\t"                                                        \
+    "rdtsc\n\t"                                                         \
+    "lfence\n\t"                                                        \
+    "movl %%eax, %%r9d\n\t"                                             \
+    "subl %%r8d, %%eax\n\t"                                             \
+    "movl %%eax, (%1)\n\t"                                              \
+    "movl %%r9d, %%r8d\n\t"                                             \
+    "addq $8, %0\n\t"                                                   \
+    "addq $4, %1\n\t"
+
+static inline void reload_batch(void **adrs, int *lat, int n)
+{
+    if (n <= 0)
+        return;
+
+    asm volatile (
+    RELOAD_BATCH_BEGIN
+    "1:\n\t"
+    RELOAD_BATCH_STEP
+    "decl %2\n\t"
+    "jnz 1b\n\t"
+    : "+r" (adrs), "+r" (lat), "+r" (n)
+    :
+    : "%rax", "%rcx", "%rdx", "%r8", "%r9", "memory");
+}
+
+/*
+ * Fixed-count specializations of reload_batch(), fully unrolled by the
+ * assembler so that no loop counter or branch ends up between the probes.
+ */
+#define DECLARE_RELOAD_BATCH(N)                                         \
+static inline void reload_batch_##N(void **adrs, int *lat)              \
+{                                                                       \
+    asm volatile (                                                      \
+    RELOAD_BATCH_BEGIN                                                  \
+    ".rept " #N "\n\t"                                                  \
+    RELOAD_BATCH_STEP                                                   \
+    ".endr\n\t"                                                         \
+    : "+r" (adrs), "+r" (lat)                                           \
+    :                                                                   \
+    : "%rax", "%rcx", "%rdx", "%r8", "%r9", "memory");                  \
+}
+
+DECLARE_RELOAD_BATCH(16)
+DECLARE_RELOAD_BATCH(256)
+
+static inline void flush(void* p)
 {
     asm volatile (  "mfence\n"
             "clflush 0(%0)\n"
@@ -81,4 +150,397 @@ void flush(void* p)
       : "rax");
 }
 
+/* flushes n lines with a single fence, instead of two per flush() */
+static inline void flush_batch(void **adrs, int n)
+{
+    int i;
+
+    asm volatile ("mfence\n" ::: "memory");
+    for (i=0; i < n; i++)
+        asm volatile ("clflush 0(%0)\n" : : "r" (adrs[i]) : "memory");
+    asm volatile ("mfence\n" ::: "memory");
+}
+
+/*
+ * Code adapted from: Gruss, Daniel, et al. "Flush+Flush: a fast and stealthy
+ * cache attack." DIMVA 2016.
+ *
+ * Times the clflush itself instead of a reload: flushing a cached line takes
+ * a different amount of time than flushing an uncached one, and the probe
+ * leaves the line flushed for the next round without any memory access.
+ */
+static inline int flush_flush( void * adrs)
+{
+    volatile unsigned long time;
+
+    asm volatile (
+    "mfence\n\t"
+    "lfence\n\t"
+    "rdtsc\n\t"
+    "lfence\n\t"
+    "movl %%eax, %%esi\n\t"
+    "clflush 0(%1)\n\t"
+    "mfence\n\t"
+    "rdtsc\n\t"
+    "subl %%esi, %%eax \n\t"
+    : "=a" (time)
+    : "c" (adrs)
+    : "%rsi", "%rdx");
+
+    return (int) time;
+}
+
+/*
+ * Hit/miss threshold calibration: builds latency histograms for a cached and
+ * an uncached probe of adrs on the current core, and picks the decision
+ * threshold that minimizes the number of misclassified samples. Pin the
+ * calling thread first when the attack runs on a fixed core.
+ *
+ * For Flush+Flush the faster case depends on the microarchitecture, so the
+ * polarity of the threshold is calibrated as well.
+ */
+#define CALIB_SAMPLES       10000
+#define CALIB_BINS          1024
+
+typedef struct {
+    int threshold;
+    int hit_above;      /* hits are latencies > threshold (else <=) */
+    int hit_med;
+    int miss_med;
+    double error_rate;
+} cache_calib_t;
+
+static inline int calib_hist_median(int *hist, int total)
+{
+    int i, sum = 0;
+
+    for (i=0; i < CALIB_BINS; i++)
+    {
+        sum += hist[i];
+        if (sum > total/2)
+            return i;
+    }
+    return CALIB_BINS-1;
+}
+
+static inline void calib_select_threshold(cache_calib_t *c, int *hit_hist, int *miss_hist,
+                                          int samples)
+{
+    int t, err, hits_above, misses_below;
+    int min_err, min_lo, min_hi, max_err, max_lo, max_hi;
+
+    /* sweep all candidate thresholds, keeping the middle of the first
+       plateau of minimal error for some margin against drift; the error of
+       the inverted polarity at threshold t is 2*samples - err */
+    hits_above = samples;
+    misses_below = 0;
+    min_err = 2*samples + 1;
+    max_err = -1;
+    min_lo = min_hi = max_lo = max_hi = 0;
+    for (t=0; t < CALIB_BINS; t++)
+    {
+        hits_above -= hit_hist[t];
+        misses_below += miss_hist[t];
+        err = hits_above + misses_below;
+
+        if (err < min_err)
+        {
+            min_err = err;
+            min_lo = min_hi = t;
+        }
+        else if (err == min_err && min_hi == t-1)
+            min_hi = t;
+
+        if (err > max_err)
+        {
+            max_err = err;
+            max_lo = max_hi = t;
+        }
+        else if (err == max_err && max_hi == t-1)
+            max_hi = t;
+    }
+
+    c->hit_above = (2*samples - max_err) < min_err;
+    if (c->hit_above)
+    {
+        c->threshold = (max_lo + max_hi) / 2;
+        c->error_rate = (double) (2*samples - max_err) / (2*samples);
+    }
+    else
+    {
+        c->threshold = (min_lo + min_hi) / 2;
+        c->error_rate = (double) min_err / (2*samples);
+    }
+    c->hit_med = calib_hist_median(hit_hist, samples);
+    c->miss_med = calib_hist_median(miss_hist, samples);
+}
+
+#define CALIB_BIN(lat)      ((lat) < CALIB_BINS ? (lat) : CALIB_BINS-1)
+
+static inline void calibrate_threshold(cache_calib_t *c, void *adrs)
+{
+    int hit_hist[CALIB_BINS] = {0}, miss_hist[CALIB_BINS] = {0};
+    int i, lat;
+
+    for (i=0; i < CALIB_SAMPLES; i++)
+    {
+        *(volatile char *) adrs;
+        lat = reload(adrs);
+        hit_hist[CALIB_BIN(lat)]++;
+
+        flush(adrs);
+        lat = reload(adrs);
+        miss_hist[CALIB_BIN(lat)]++;
+    }
+
+    calib_select_threshold(c, hit_hist, miss_hist, CALIB_SAMPLES);
+}
+
+static inline void calibrate_threshold_ff(cache_calib_t *c, void *adrs)
+{
+    int hit_hist[CALIB_BINS] = {0}, miss_hist[CALIB_BINS] = {0};
+    int i, lat;
+
+    for (i=0; i < CALIB_SAMPLES; i++)
+    {
+        *(volatile char *) adrs;
+        lat = flush_flush(adrs);
+        hit_hist[CALIB_BIN(lat)]++;
+
+        /* the line is now flushed by the previous probe */
+        lat = flush_flush(adrs);
+        miss_hist[CALIB_BIN(lat)]++;
+    }
+
+    calib_select_threshold(c, hit_hist, miss_hist, CALIB_SAMPLES);
+}
+
+static inline int cache_hit(cache_calib_t *c, int lat)
+{
+    return c->hit_above ? lat > c->threshold : lat <= c->threshold;
+}
+
+/*
+ * Pluggable timers for timing whole functions (e.g., check_pwd() in 001-pwd),
+ * where the CPUID and two MFENCEs of rdtsc_begin()/rdtsc_end() add a large
+ * and noisy fixed cost to every sample:
+ *
+ *  - TIMER_FENCED: rdtsc_begin()/rdtsc_end() as above.
+ *  - TIMER_RDTSCP: a bare RDTSCP, which only waits for earlier instructions.
+ *  - TIMER_LFENCE: LFENCE; RDTSC; LFENCE.
+ *  - TIMER_THREAD: a counter incremented by a thread on a sibling core; its
+ *    ticks are not cycles, but it needs no timestamp instruction at all.
+ *
+ * timer_init() measures the median cost of an empty begin/end pair on the
+ * calling core, and timer_elapsed() subtracts it. Call timer_init() again
+ * after moving to another core.
+ */
+enum { TIMER_FENCED, TIMER_RDTSCP, TIMER_LFENCE, TIMER_THREAD, TIMER_NUM };
+
+static const char *const timer_names[TIMER_NUM] = {
+    "fenced", "rdtscp", "lfence", "thread"
+};
+
+#define TIMER_CALIB_SAMPLES 10000
+
+typedef struct {
+    int kind;
+    int cpu;                    /* core the overhead was calibrated on */
+    uint64_t overhead;
+    volatile uint64_t count;    /* TIMER_THREAD only */
+    volatile int stop;
+    pthread_t thread;
+} cache_timer_t;
+
+static inline uint64_t timer_read(cache_timer_t *t)
+{
+    uint32_t a, d;
+    uint64_t v;
+
+    switch (t->kind)
+    {
+        case TIMER_RDTSCP:
+            asm volatile ("rdtscp\n\t" : "=a" (a), "=d" (d) : : "%ecx");
+            return ((uint64_t)d << 32) | a;
+
+        case TIMER_THREAD:
+            asm volatile ("lfence\n\t" : : : "memory");
+            v = t->count;
+            asm volatile ("lfence\n\t" : : : "memory");
+            return v;
+
+        default:
+            asm volatile ("lfence\n\t"
+                          "rdtsc\n\t"
+                          "lfence\n\t" : "=a" (a), "=d" (d));
+            return ((uint64_t)d << 32) | a;
+    }
+}
+
+static inline uint64_t timer_begin(cache_timer_t *t)
+{
+    return (t->kind == TIMER_FENCED) ? rdtsc_begin() : timer_read(t);
+}
+
+static inline uint64_t timer_end(cache_timer_t *t)
+{
+    return (t->kind == TIMER_FENCED) ? rdtsc_end() : timer_read(t);
+}
+
+static inline uint64_t timer_elapsed(cache_timer_t *t, uint64_t begin, uint64_t end)
+{
+    return (end - begin > t->overhead) ? end - begin - t->overhead : 0;
+}
+
+static inline void *timer_count(void *arg)
+{
+    cache_timer_t *t = arg;
+
+    while (!t->stop)
+        t->count++;
+
+    return NULL;
+}
+
+/* hyperthread of 'cpu' if there is one, else any other online core */
+static inline int timer_sibling_cpu(int cpu)
+{
+    char path[128];
+    FILE *f;
+    int c, ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if ((f = fopen(path, "r")))
+    {
+        while (fscanf(f, "%d%*[,-]", &c) == 1)
+            if (c != cpu)
+            {
+                fclose(f);
+                return c;
+            }
+        fclose(f);
+    }
+
+    return (ncpu > 1) ? (cpu+1) % ncpu : -1;
+}
+
+/*
+ * One logical CPU per physical core we may run on, at most max. Always
+ * returns at least 1: without the affinity mask, just the current CPU.
+ */
+static inline int physical_cores(int *cpus, int max)
+{
+    int ids[max][2], n = 0, cpu, core, pkg, i;
+    char path[128];
+    cpu_set_t set;
+    FILE *f;
+
+    if (sched_getaffinity(0, sizeof(set), &set))
+    {
+        cpus[0] = (sched_getcpu() >= 0) ? sched_getcpu() : 0;
+        return 1;
+    }
+    for (cpu=0; cpu < CPU_SETSIZE && n < max; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+
+        core = pkg = -1;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        if ((f = fopen(path, "r")))
+        {
+            if (fscanf(f, "%d", &core) != 1)
+                core = -1;
+            fclose(f);
+        }
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        if ((f = fopen(path, "r")))
+        {
+            if (fscanf(f, "%d", &pkg) != 1)
+                pkg = -1;
+            fclose(f);
+        }
+
+        /* skip hyperthreads of cores we already have */
+        for (i=0; i < n; i++)
+            if (core >= 0 && ids[i][0] == core && ids[i][1] == pkg)
+                break;
+        if (i < n)
+            continue;
+
+        ids[n][0] = core;
+        ids[n][1] = pkg;
+        cpus[n++] = cpu;
+    }
+
+    return n;
+}
+
+static inline int timer_parse(const char *name)
+{
+    int i;
+
+    for (i=0; i < TIMER_NUM; i++)
+        if (!strcmp(name, timer_names[i]))
+            return i;
+
+    return -1;
+}
+
+/* Returns 0 on success, -1 if the backend is not available here. */
+static inline int timer_init(cache_timer_t *t, int kind)
+{
+    int hist[CALIB_BINS] = {0};
+    uint64_t t1, t2, lat;
+    cpu_set_t set;
+    int i, sib;
+
+    t->kind = kind;
+    t->cpu = sched_getcpu();
+    t->overhead = 0;
+    t->count = 0;
+    t->stop = 0;
+
+    if (kind == TIMER_THREAD)
+    {
+        /* stay on this core, and count on another one */
+        if ((sib = timer_sibling_cpu(t->cpu)) < 0)
+            return -1;
+        CPU_ZERO(&set);
+        CPU_SET(t->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+        if (pthread_create(&t->thread, NULL, timer_count, t))
+            return -1;
+        CPU_ZERO(&set);
+        CPU_SET(sib, &set);
+        pthread_setaffinity_np(t->thread, sizeof(set), &set);
+
+        while (!t->count);
+    }
+
+    for (i=0; i < TIMER_CALIB_SAMPLES; i++)
+    {
+        t1 = timer_begin(t);
+        t2 = timer_end(t);
+        lat = t2 - t1;
+        hist[CALIB_BIN(lat)]++;
+    }
+    t->overhead = calib_hist_median(hist, TIMER_CALIB_SAMPLES);
+
+    return 0;
+}
+
+static inline void timer_destroy(cache_timer_t *t)
+{
+    if (t->kind != TIMER_THREAD)
+        return;
+
+    t->stop = 1;
+    pthread_join(t->thread, NULL);
+}
+
 #endif
@@ -0,0 +1,144 @@
+#include "debug.h"
+#include "fr.h"
+#include "xorshift.h"
+#include <time.h>
+
+typedef struct {
+    void **slots;
+    int n;
+    cache_calib_t *calib;
+    fr_victim_t victim;
+    void *arg;
+    uint64_t wait, rounds;
+    int cpu;
+    volatile int stop;
+    volatile int done;
+    volatile uint64_t calls;
+    fr_ring_t ring;
+} fr_ctx_t;
+
+static void fr_pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    ASSERT(!sched_setaffinity(0, sizeof(set), &set));
+}
+
+static void *fr_victim_main(void *p)
+{
+    fr_ctx_t *c = p;
+
+    fr_pin(c->cpu);
+    while (!c->stop)
+    {
+        c->victim(c->arg);
+        c->calls++;
+    }
+    return NULL;
+}
+
+static void *fr_attacker_main(void *p)
+{
+    fr_ctx_t *c = p;
+    int lat[FR_MAX_SLOTS], perm[FR_MAX_SLOTS], k, j, tmp;
+    void *probe[FR_MAX_SLOTS];
+    uint64_t r, t, x = xorshift_seed();
+    fr_event_t e;
+
+    fr_pin(c->cpu);
+    for (k=0; k < c->n; k++)
+        perm[k] = k;
+
+    for (r=0; r < c->rounds; r++)
+    {
+        /* reload in a fresh random order, so no prefetcher can run ahead */
+        for (k=c->n-1; k > 0; k--)
+        {
+            j = xorshift(&x) % (k+1);
+            tmp = perm[k]; perm[k] = perm[j]; perm[j] = tmp;
+        }
+        for (k=0; k < c->n; k++)
+            probe[k] = c->slots[perm[k]];
+
+        flush_batch(c->slots, c->n);
+        t = rdtsc_begin();
+        while (rdtsc_begin() - t < c->wait);
+        reload_batch(probe, lat, c->n);
+
+        for (k=0; k < c->n; k++)
+            if (cache_hit(c->calib, lat[k]))
+            {
+                e.tsc = t;
+                e.round = r;
+                e.slot = perm[k];
+                fr_ring_push(&c->ring, &e);
+            }
+    }
+
+    __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void fr_async(void **slots, int n, cache_calib_t *calib,
+              fr_victim_t victim, void *arg,
+              uint64_t wait, uint64_t rounds, fr_result_t *res)
+{
+    static fr_ctx_t vc, ac;
+    fr_event_t ev[256];
+    pthread_t vt, at;
+    struct timespec t1, t2;
+    uint64_t calls;
+    int cpus[2], ncpus, i, m;
+
+    ASSERT(n <= FR_MAX_SLOTS);
+    memset(res, 0, sizeof(*res));
+    if ((ncpus = physical_cores(cpus, 2)) < 2)
+    {
+        info("WARNING: one core only; victim and attacker share it");
+        cpus[1] = cpus[0];
+    }
+
+    vc.victim = victim;
+    vc.arg = arg;
+    vc.cpu = res->victim_cpu = cpus[0];
+    vc.stop = 0;
+    vc.calls = 0;
+
+    ac.slots = slots;
+    ac.n = n;
+    ac.calib = calib;
+    ac.wait = wait;
+    ac.rounds = rounds;
+    ac.cpu = res->attacker_cpu = cpus[1];
+    ac.done = 0;
+    fr_ring_init(&ac.ring);
+
+    ASSERT(!pthread_create(&vt, NULL, fr_victim_main, &vc));
+    while (!vc.calls);
+
+    calls = vc.calls;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ASSERT(!pthread_create(&at, NULL, fr_attacker_main, &ac));
+
+    /* drain until the attacker is done and the ring is empty */
+    do {
+        i = __atomic_load_n(&ac.done, __ATOMIC_ACQUIRE);
+        while ((m = fr_ring_pop(&ac.ring, ev, 256)) > 0)
+            while (m--)
+                res->hits[ev[m].slot]++;
+        if (!i)
+            sched_yield();
+    } while (!i);
+
+    ASSERT(!pthread_join(at, NULL));
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    res->victim_calls = vc.calls - calls;
+    vc.stop = 1;
+    ASSERT(!pthread_join(vt, NULL));
+
+    res->rounds = rounds;
+    res->dropped = ac.ring.dropped;
+    res->secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+}
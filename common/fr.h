@@ -0,0 +1,48 @@
+#ifndef FR_H_INC
+#define FR_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cacheutils.h"
+#include "ring.h"
+
+/*
+ * Asynchronous cross-core Flush+Reload.
+ *
+ * Instead of flush, victim call and reload in lockstep, the victim calls
+ * itself in a loop on one core while an attacker thread on another physical
+ * core runs flush / wait 'wait' cycles / reload (in a random order) over the
+ * slots for 'rounds' rounds. Every hit goes out as an event (round, slot,
+ * tsc) through an SPSC ring (fr_ring, see ring.h), which the calling thread
+ * drains into per-slot hit counts. The wait interval sets the probe
+ * frequency: a longer wait catches more victim accesses per round, a shorter
+ * one resolves them more finely in time.
+ */
+#define FR_MAX_SLOTS        256
+#define FR_RING_SIZE        4096    /* power of two */
+
+typedef struct {
+    uint64_t tsc;
+    uint32_t round;
+    int32_t slot;
+} fr_event_t;
+
+RING_DEFINE(fr_ring, fr_event_t, FR_RING_SIZE)
+
+typedef void (*fr_victim_t)(void *arg);
+
+typedef struct {
+    uint64_t hits[FR_MAX_SLOTS];    /* hit events per slot */
+    uint64_t rounds;
+    uint64_t victim_calls;          /* during the probe rounds */
+    uint64_t dropped;               /* events lost to a full ring */
+    double secs;
+    int victim_cpu, attacker_cpu;
+} fr_result_t;
+
+void fr_async(void **slots, int n, cache_calib_t *calib,
+              fr_victim_t victim, void *arg,
+              uint64_t wait, uint64_t rounds, fr_result_t *res);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef OBLIVIOUS_H_INC
+#define OBLIVIOUS_H_INC
+
+#include <stdint.h>
+#include <stddef.h>
+#include <immintrin.h>
+
+/*
+ * Oblivious table reads: return array[off], but touch the same position in
+ * every stride-sized slot of array[0..len) on every call, so that the cache
+ * footprint does not depend on which slot holds off. The position within the
+ * slot (off % stride) is not hidden: use stride = 64 (a cache line) unless
+ * off is known to be slot aligned, e.g. a multiple of a page-sized stride.
+ *
+ * oblivious_read_cmov() loads one byte per slot and keeps the wanted one
+ * with a cmov, so neither the loads nor the branches depend on off.
+ * oblivious_read_avx2() gathers 8 slots per step (32-bit lanes) and keeps
+ * the wanted lane with a compare mask; it needs len and stride to be
+ * multiples of 4, and falls back to the cmov scan otherwise (a decision on
+ * public values only). Check oblivious_has_avx2() before calling it.
+ */
+
+static inline int oblivious_read_cmov(const char *array, size_t len,
+                                      size_t off, size_t stride)
+{
+    uint64_t a, v, r = 0;
+
+    for (a = off % stride; a < len; a += stride)
+    {
+        v = *(volatile const unsigned char *) (array + a);
+        asm volatile ("cmp %2, %3\n\t"
+                      "cmove %1, %0\n\t"
+                      : "+r" (r) : "r" (v), "r" (a), "r" (off) : "cc");
+    }
+
+    return (int) r;
+}
+
+static inline int oblivious_has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static inline int oblivious_read_avx2(const char *array, size_t len,
+                                      size_t off, size_t stride)
+{
+    __m256i idx, mask, v, acc = _mm256_setzero_si256();
+    __m128i x;
+    size_t start, a;
+    uint32_t r;
+
+    if (len % 4 || stride % 4 || len + 8*stride > INT32_MAX)
+        return oblivious_read_cmov(array, len, off, stride);
+
+    /* gather the aligned dword around the byte in each slot: with len and
+       stride multiples of 4, it never reaches past the end */
+    start = (off % stride) & ~(size_t) 3;
+    idx = _mm256_add_epi32(_mm256_set1_epi32(start),
+            _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                               _mm256_set1_epi32(stride)));
+
+    for (a = start; a < len; a += 8*stride)
+    {
+        /* lanes past the end of the array are not loaded */
+        mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(len), idx);
+        v = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                                        (const int *) array, idx, mask, 1);
+        acc = _mm256_or_si256(acc, _mm256_and_si256(v,
+                _mm256_cmpeq_epi32(idx, _mm256_set1_epi32(off & ~(size_t) 3))));
+        idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8*stride));
+    }
+
+    /* exactly one lane was kept: OR them together */
+    x = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    x = _mm_or_si128(x, _mm_shuffle_epi32(x, 0x4e));
+    x = _mm_or_si128(x, _mm_shuffle_epi32(x, 0xb1));
+    r = _mm_cvtsi128_si32(x);
+
+    return (r >> (8 * (off % 4))) & 0xff;
+}
+
+#endif
@@ -1,20 +1,78 @@
 #include "debug.h"
 #include "pf.h"
+#include "ring.h"
 #include <signal.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
 
 fault_handler_t __fault_handler_cb = NULL;
+int pf_backend = PF_BACKEND_SIGSEGV;
+int pf_uffd = -1;
+pthread_t pf_uffd_thread;
+__thread int pf_in_monitor = 0;
+__thread ucontext_t *pf_uc = NULL;
+
+/* single producer (the signal handler), single consumer ring */
+RING_DEFINE(pf_ring, pf_record_t, PF_TRACE_SIZE)
+pf_ring_t pf_trace;
+
+static inline uint64_t pf_rdtsc(void)
+{
+  uint32_t a, d;
+
+  asm volatile ("rdtsc\n\t" : "=a" (a), "=d" (d));
+  return ((uint64_t)d << 32) | a;
+}
+
+static inline void pf_trace_add(void *page, void *adrs, uint64_t rip, uint64_t tsc)
+{
+  pf_record_t r = { .page = page, .adrs = adrs, .rip = rip, .tsc = tsc };
+
+  /* never blocks in signal context: drops the record when full */
+  pf_ring_push(&pf_trace, &r);
+}
+
+int pf_trace_drain(pf_record_t *out, int max)
+{
+  return pf_ring_pop(&pf_trace, out, max);
+}
+
+int pf_trace_dump(void)
+{
+  pf_record_t r;
+  int n = 0;
+
+  while (pf_trace_drain(&r, 1))
+  {
+    info("Caught page fault (base address=%p; adrs=%p; rip=%#lx; tsc=%lu)",
+         r.page, r.adrs, r.rip, r.tsc);
+    n++;
+  }
+
+  return n;
+}
+
+uint64_t pf_trace_dropped(void)
+{
+  return __atomic_load_n(&pf_trace.dropped, __ATOMIC_RELAXED);
+}
 
 void fault_handler_wrapper (int signo, siginfo_t * si, void  *ctx)
 {
   void *base_adrs;
   ucontext_t *uc = (ucontext_t *) ctx;
+  uint64_t tsc = pf_rdtsc();
 
   switch ( signo )
   {
     case SIGSEGV:
       base_adrs = si->si_addr;
-      info("Caught page fault (base address=%p)", base_adrs);
       break;
 
     default:
@@ -25,9 +83,17 @@ void fault_handler_wrapper (int signo, siginfo_t * si, void  *ctx)
   /* Mask lower PFN bits to simulate clearing by SGX hardware when executing
      the unprotected programs */
   base_adrs = GET_PFN(base_adrs);
+  pf_trace_add(base_adrs, si->si_addr, uc->uc_mcontext.gregs[REG_RIP], tsc);
 
+  pf_uc = uc;
   if (__fault_handler_cb)
     __fault_handler_cb(base_adrs);
+  pf_uc = NULL;
+}
+
+ucontext_t *pf_fault_context(void)
+{
+  return pf_uc;
 }
 
 void register_fault_handler(fault_handler_t cb)
@@ -46,3 +112,133 @@ void register_fault_handler(fault_handler_t cb)
 
   __fault_handler_cb = cb;
 }
+
+void *pf_uffd_monitor(void *arg)
+{
+  struct uffd_msg msg;
+  struct uffdio_range wake;
+  void *adrs, *base_adrs;
+  uint64_t tsc;
+
+  pf_in_monitor = 1;
+  while (read(pf_uffd, &msg, sizeof(msg)) == sizeof(msg))
+  {
+    tsc = pf_rdtsc();
+    if (msg.event != UFFD_EVENT_PAGEFAULT)
+      continue;
+
+    adrs = (void *) msg.arg.pagefault.address;
+    base_adrs = GET_PFN(adrs);
+    pf_trace_add(base_adrs, adrs, 0, tsc);
+
+    /* like a signal handler, the callback completes before the faulting
+       thread resumes (pf_protect() does not wake it from here) */
+    if (__fault_handler_cb)
+      __fault_handler_cb(base_adrs);
+
+    wake.start = (uint64_t) base_adrs;
+    wake.len = PFN_MASK+1;
+    ASSERT(!ioctl(pf_uffd, UFFDIO_WAKE, &wake));
+  }
+
+  return NULL;
+}
+
+/* only our own (user-mode) faults are tracked, which unprivileged
+   processes may do even with vm.unprivileged_userfaultfd=0 */
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+static int pf_uffd_open(struct uffdio_api *api)
+{
+  int fd;
+
+  if ((fd = syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY)) < 0 &&
+      (fd = syscall(SYS_userfaultfd, O_CLOEXEC)) < 0)
+    return -1;
+
+  if (ioctl(fd, UFFDIO_API, api))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int register_fault_handler_backend(fault_handler_t cb, int backend)
+{
+  struct uffdio_api api = { .api = UFFD_API, .features = 0 };
+  uint64_t features;
+  int fd;
+
+  if (backend == PF_BACKEND_SIGSEGV)
+  {
+    register_fault_handler(cb);
+    return PF_BACKEND_SIGSEGV;
+  }
+
+  /* UFFDIO_API can be issued only once per descriptor, so query first */
+  if ((fd = pf_uffd_open(&api)) >= 0)
+  {
+    features = api.features;
+    close(fd);
+
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP |
+                   (features & UFFD_FEATURE_EXACT_ADDRESS);
+    fd = (features & UFFD_FEATURE_PAGEFAULT_FLAG_WP) ? pf_uffd_open(&api) : -1;
+  }
+
+  if (fd < 0)
+  {
+    info("WARNING: no userfaultfd write-protection; falling back to SIGSEGV");
+    pf_backend = PF_BACKEND_SIGSEGV;
+    register_fault_handler(cb);
+    return PF_BACKEND_SIGSEGV;
+  }
+
+  pf_uffd = fd;
+  __fault_handler_cb = cb;
+  pf_backend = backend;
+  ASSERT(!pthread_create(&pf_uffd_thread, NULL, pf_uffd_monitor, NULL));
+  return PF_BACKEND_UFFD;
+}
+
+int pf_track(void *adrs, size_t len)
+{
+  struct uffdio_register reg;
+  char *p, *start = GET_PFN(adrs), *end = (char *) adrs + len;
+
+  if (pf_backend != PF_BACKEND_UFFD)
+    return 0;
+
+  /* write-protection only sticks to pages that are populated */
+  for (p = start; p < end; p += PFN_MASK+1)
+    *(volatile char *) p = *(volatile char *) p;
+
+  reg.range.start = (uint64_t) start;
+  reg.range.len = (uint64_t) GET_PFN(end + PFN_MASK) - (uint64_t) start;
+  reg.mode = UFFDIO_REGISTER_MODE_WP;
+  return ioctl(pf_uffd, UFFDIO_REGISTER, &reg);
+}
+
+void pf_protect(void *page, int prot)
+{
+  struct uffdio_writeprotect wp;
+
+  if (pf_backend == PF_BACKEND_SIGSEGV)
+  {
+    ASSERT(!mprotect(page, PFN_MASK+1, prot));
+    return;
+  }
+
+  /* lifting the protection also wakes up the faulting thread, except
+     from within the callback (the monitor wakes it afterwards) */
+  wp.range.start = (uint64_t) GET_PFN(page);
+  wp.range.len = PFN_MASK+1;
+  wp.mode = (prot & PROT_WRITE) ? 0 : UFFDIO_WRITEPROTECT_MODE_WP;
+  if (pf_in_monitor)
+    wp.mode |= UFFDIO_WRITEPROTECT_MODE_DONTWAKE;
+  ASSERT(!ioctl(pf_uffd, UFFDIO_WRITEPROTECT, &wp));
+}
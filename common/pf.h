@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <ucontext.h>
 
 #define PFN_MASK 0xfff 
 
@@ -12,4 +13,60 @@
 typedef void (*fault_handler_t)(void *page_base_adrs);
 void register_fault_handler(fault_handler_t cb);
 
+/*
+ * Tracking backends: SIGSEGV plus mprotect() (the default), or userfaultfd
+ * write-protection, where a monitor thread receives the faults and the
+ * faulting thread sleeps until the callback lifts the protection. The latter
+ * only traps writes, and only on anonymous memory registered with
+ * pf_track(); it reports no RIP in the fault records.
+ *
+ * If no userfaultfd with write-protection can be created (e.g. unprivileged
+ * with vm.unprivileged_userfaultfd=0 on kernels without user-mode-only
+ * descriptors), this warns and falls back to SIGSEGV. Returns the backend
+ * actually in use.
+ */
+enum { PF_BACKEND_SIGSEGV, PF_BACKEND_UFFD };
+
+int register_fault_handler_backend(fault_handler_t cb, int backend);
+
+/* Register [adrs, adrs+len) with the uffd backend (no-op for SIGSEGV). */
+int pf_track(void *adrs, size_t len);
+
+/*
+ * Set the access rights of one page with the active backend: mprotect(), or
+ * (un)write-protect, where any prot without PROT_WRITE traps writes.
+ */
+void pf_protect(void *page, int prot);
+
+/*
+ * Register context the faulting thread resumes with, valid only while a
+ * SIGSEGV-backend callback runs (NULL otherwise, and for uffd); changes to
+ * it, e.g., setting the trap flag (see ss.h), take effect on return.
+ */
+ucontext_t *pf_fault_context(void);
+
+/*
+ * The SIGSEGV handler does not print anything itself (printf is slow and not
+ * async-signal-safe), but appends a binary record for every fault to a
+ * preallocated lock-free ring (ring.h). Drivers consume the records outside
+ * of signal context, e.g., by calling pf_trace_dump() after an ecall.
+ */
+typedef struct {
+    void *page;         /* page base address, as passed to the fault handler */
+    void *adrs;         /* full faulting address (si_addr) */
+    uint64_t rip;       /* faulting instruction */
+    uint64_t tsc;
+} pf_record_t;
+
+#define PF_TRACE_SIZE       4096    /* records; must be a power of two */
+
+/* Consume up to max pending records into out; returns the number copied. */
+int pf_trace_drain(pf_record_t *out, int max);
+
+/* Print and consume all pending records; returns the number printed. */
+int pf_trace_dump(void);
+
+/* Number of records lost so far because the ring was full. */
+uint64_t pf_trace_dropped(void);
+
 #endif
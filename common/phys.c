@@ -0,0 +1,199 @@
+#include "debug.h"
+#include "phys.h"
+#include "pp.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PHYS_PRESENT        (1ull << 63)
+#define PHYS_PFN_MASK       ((1ull << 55) - 1)
+/* a single lookup also fetches its neighbours: one pread either way */
+#define PHYS_READAHEAD      64
+
+/* XOR of these physical address bits gives bit i of the slice number */
+static const uint64_t phys_slice_mask[3] = {
+    0x1b5f575440ull,    /* 6,10,12,14,16,17,18,20,22,24,25,26,27,28,30,32,33,35,36 */
+    0x2eb5faa880ull,    /* 7,11,13,15,17,19,20,21,22,23,24,26,28,29,31,33,34,35,37 */
+    0x3cccc93100ull,    /* 8,12,13,16,19,22,23,26,27,30,31,34,35,36,37 */
+};
+
+int phys_fd = -1;
+phys_geom_t phys_geom;
+uint64_t phys_tag[PHYS_CACHE_SIZE];     /* vpn+1, 0 if empty */
+uint64_t phys_pfn[PHYS_CACHE_SIZE];
+
+/* the hash is documented for the client (non-Xeon) ring parts only */
+static int phys_client_part(void)
+{
+    char line[256];
+    int intel = 0, xeon = 0;
+    FILE *f;
+
+    if (!(f = fopen("/proc/cpuinfo", "r")))
+        return 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (!strncmp(line, "vendor_id", 9))
+            intel = (strstr(line, "GenuineIntel") != NULL);
+        else if (!strncmp(line, "model name", 10))
+        {
+            xeon = (strstr(line, "Xeon") != NULL);
+            break;
+        }
+    }
+    fclose(f);
+
+    return intel && !xeon;
+}
+
+int phys_init(void)
+{
+    phys_geom_t *g = &phys_geom;
+    uint64_t e = 0;
+
+    if (phys_fd < 0)
+    {
+        g->line = pp_cache_attr(1, "coherency_line_size", 64);
+        g->l1_sets = pp_cache_attr(1, "number_of_sets", 64);
+        g->l2_sets = pp_cache_attr(2, "number_of_sets", 1024);
+        g->llc_sets = pp_cache_attr(3, "number_of_sets", 0);
+        if (!g->llc_sets)
+            g->llc_sets = g->l2_sets;
+
+        g->llc_slices = (g->llc_sets >= PHYS_SLICE_SETS) ?
+                        g->llc_sets / PHYS_SLICE_SETS : 1;
+        g->slice_sets = g->llc_sets / g->llc_slices;
+        g->slice_hash = phys_client_part() && (g->llc_slices == 1 ||
+                        g->llc_slices == 2 || g->llc_slices == 4 ||
+                        g->llc_slices == 8);
+
+        phys_fd = open("/proc/self/pagemap", O_RDONLY);
+        if (phys_fd < 0)
+            return -1;
+        phys_invalidate();
+    }
+
+    /* without CAP_SYS_ADMIN, present pages have a zero PFN */
+    *(volatile char *) &e;
+    if (pread(phys_fd, &e, sizeof(e),
+              ((uint64_t) &e / PHYS_PAGE_SIZE) * sizeof(e)) != sizeof(e))
+        return -1;
+    return (e & PHYS_PRESENT) && (e & PHYS_PFN_MASK) ? 0 : -1;
+}
+
+const phys_geom_t *phys_geometry(void)
+{
+    if (phys_fd < 0)
+        phys_init();
+    return &phys_geom;
+}
+
+void phys_invalidate(void)
+{
+    memset(phys_tag, 0, sizeof(phys_tag));
+}
+
+/* read n pagemap entries from vpn on and cache the present ones */
+static void phys_fill(uint64_t vpn, int n)
+{
+    uint64_t e[PHYS_BATCH];
+    ssize_t rv;
+    int i, slot;
+
+    if (phys_fd < 0)
+        phys_init();
+    if (phys_fd < 0)
+        return;
+
+    rv = pread(phys_fd, e, n*sizeof(uint64_t), vpn*sizeof(uint64_t));
+    for (i=0; i < rv / (ssize_t) sizeof(uint64_t); i++)
+    {
+        if (!(e[i] & PHYS_PRESENT) || !(e[i] & PHYS_PFN_MASK))
+            continue;
+        slot = (vpn+i) % PHYS_CACHE_SIZE;
+        phys_tag[slot] = vpn+i+1;
+        phys_pfn[slot] = e[i] & PHYS_PFN_MASK;
+    }
+}
+
+static inline int phys_cached(uint64_t vpn, uint64_t *pfn)
+{
+    int slot = vpn % PHYS_CACHE_SIZE;
+
+    if (phys_tag[slot] != vpn+1)
+        return 0;
+    *pfn = phys_pfn[slot];
+    return 1;
+}
+
+uint64_t phys_addr(void *va)
+{
+    uint64_t vpn = (uint64_t) va / PHYS_PAGE_SIZE, pfn;
+
+    if (!phys_cached(vpn, &pfn))
+    {
+        phys_fill(vpn & ~(uint64_t) (PHYS_READAHEAD-1), PHYS_READAHEAD);
+        if (!phys_cached(vpn, &pfn))
+            return 0;
+    }
+
+    return pfn*PHYS_PAGE_SIZE + (uint64_t) va % PHYS_PAGE_SIZE;
+}
+
+int phys_llc_slice(uint64_t pa)
+{
+    int i, slice = 0, bits = 0;
+
+    if (!phys_geom.slice_hash || !pa)
+        return -1;
+    while ((1 << bits) < phys_geom.llc_slices)
+        bits++;
+    for (i=0; i < bits; i++)
+        slice |= __builtin_parityll(pa & phys_slice_mask[i]) << i;
+
+    return slice;
+}
+
+void phys_sets(uint64_t pa, phys_info_t *info)
+{
+    const phys_geom_t *g = phys_geometry();
+    uint64_t line = pa / g->line;
+
+    info->pa = pa;
+    if (!pa)
+    {
+        info->l1_set = info->l2_set = info->llc_set = info->slice = -1;
+        return;
+    }
+    info->l1_set = line % g->l1_sets;
+    info->l2_set = line % g->l2_sets;
+    info->llc_set = line % g->slice_sets;
+    info->slice = phys_llc_slice(pa);
+}
+
+int phys_query(void *start, size_t len, size_t stride, phys_info_t *out, int max)
+{
+    uint64_t va = (uint64_t) start, end = va + len, last, vpn, pfn;
+    int n;
+
+    if (!stride || !len)
+        return 0;
+    last = (end-1) / PHYS_PAGE_SIZE;
+
+    for (n=0; va < end && n < max; va += stride, n++)
+    {
+        vpn = va / PHYS_PAGE_SIZE;
+        if (!phys_cached(vpn, &pfn))
+        {
+            /* fetch the rest of the range (up to a batch) in one go */
+            phys_fill(vpn, (last-vpn+1 < PHYS_BATCH) ? last-vpn+1 : PHYS_BATCH);
+            if (!phys_cached(vpn, &pfn))
+                pfn = 0;
+        }
+
+        out[n].va = va;
+        phys_sets(pfn ? pfn*PHYS_PAGE_SIZE + va % PHYS_PAGE_SIZE : 0, &out[n]);
+    }
+
+    return n;
+}
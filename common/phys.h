@@ -0,0 +1,72 @@
+#ifndef PHYS_H_INC
+#define PHYS_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Virtual-to-physical translation and cache-set mapping.
+ *
+ * Translations come from /proc/self/pagemap, which only reports page frame
+ * numbers to processes with CAP_SYS_ADMIN (others read them as 0). Entries
+ * are read in bulk, one pread() per run of up to PHYS_BATCH pages, and
+ * present pages are kept in a direct-mapped cache of PHYS_CACHE_SIZE
+ * translations. Only pages that are populated at query time translate:
+ * touch (or MAP_POPULATE) a buffer before querying it.
+ *
+ * Set indices use the cache geometry from sysfs. The LLC of Intel parts
+ * since Sandy Bridge is split into slices of PHYS_SLICE_SETS sets, selected
+ * by a hash of the physical address. The hash is only known (reverse
+ * engineered, Maurice et al., RAID 2015) for the ring-based client parts
+ * with 1, 2, 4 or 8 slices; elsewhere the slice reads as -1 and llc_set is
+ * the set within the (unknown) slice.
+ */
+#define PHYS_PAGE_SIZE      0x1000
+#define PHYS_BATCH          512
+#define PHYS_CACHE_SIZE     4096
+#define PHYS_SLICE_SETS     2048
+
+typedef struct {
+    int line;               /* cache line size in bytes */
+    int l1_sets;
+    int l2_sets;
+    int llc_sets;           /* total, over all slices */
+    int llc_slices;
+    int slice_sets;         /* sets per LLC slice */
+    int slice_hash;         /* 1 if the slice hash is known for this part */
+} phys_geom_t;
+
+typedef struct {
+    uint64_t va;
+    uint64_t pa;            /* 0 if not available */
+    int l1_set;
+    int l2_set;
+    int llc_set;            /* within the slice */
+    int slice;              /* -1 if unknown */
+} phys_info_t;
+
+/*
+ * Open pagemap and read the cache geometry. Returns 0 if physical addresses
+ * are available, -1 otherwise (set indices then read as -1 too).
+ */
+int phys_init(void);
+const phys_geom_t *phys_geometry(void);
+
+/* Physical address of va, or 0 if unavailable. */
+uint64_t phys_addr(void *va);
+
+/*
+ * Translate every stride-th byte of [start, start+len), at most max
+ * addresses, into out[]. Returns the number of entries written.
+ */
+int phys_query(void *start, size_t len, size_t stride, phys_info_t *out, int max);
+
+/* Set indices (and slice) of a physical address. */
+void phys_sets(uint64_t pa, phys_info_t *info);
+int phys_llc_slice(uint64_t pa);
+
+/* Drop cached translations (after munmap/mremap or page migration). */
+void phys_invalidate(void);
+
+#endif
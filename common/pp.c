@@ -0,0 +1,462 @@
+#include "debug.h"
+#include "pp.h"
+#include "cacheutils.h"
+#include "phys.h"
+#include <sys/mman.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Noise (interrupts, the hypervisor) only ever makes an L2 hit look slow, so
+ * a line only counts as evicted if every one of these timings says so.
+ */
+#define PP_TEST_REPS        4
+#define PP_CALIB_SAMPLES    1000
+#define PP_HIT_QUANTILE     0.99
+/* L1 is 8-12 way, so this many same-offset lines leave the target in L2 */
+#define PP_CALIB_SMALL      24
+#define PP_MAX_TRIES        1024
+#define PP_MAX_BACKTRACKS   64
+
+#define POOL_LINE(pool, i)  ((pool) + (size_t)(i)*PP_PAGE_SIZE)
+
+/*
+ * Traversing hundreds of pages thrashes the DTLB, and the page walk for the
+ * target would otherwise push an L2 hit across the threshold. Touching a
+ * line in the other half of the target's page restores the translation
+ * without touching the target's cache set.
+ */
+#define PP_WARM_TLB(p)      (*(volatile char *) ((uint64_t) (p) ^ (PP_PAGE_SIZE/2)))
+
+int pp_threshold = 0;
+
+int pp_cache_attr(int level, const char *attr, int def)
+{
+    char path[128];
+    FILE *f;
+    int i, val;
+
+    /* index0/1 are the L1 data/instruction caches, so search by level */
+    for (i=0; i < 8; i++)
+    {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (!(f = fopen(path, "r")))
+            break;
+        val = (fscanf(f, "%d", &val) == 1) ? val : -1;
+        fclose(f);
+        if (val != level)
+            continue;
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/%s", i, attr);
+        if (!(f = fopen(path, "r")))
+            break;
+        val = (fscanf(f, "%d", &val) == 1) ? val : def;
+        fclose(f);
+        return val;
+    }
+
+    return def;
+}
+
+int pp_l2_ways(void)
+{
+    return pp_cache_attr(2, "ways_of_associativity", 16);
+}
+
+int pp_l2_colours(void)
+{
+    return pp_cache_attr(2, "number_of_sets", 1024) * PP_LINE_SIZE / PP_PAGE_SIZE;
+}
+
+char *pp_alloc_pool(int pool_pages)
+{
+    size_t len = (size_t) pool_pages*PP_PAGE_SIZE;
+    char *pool;
+
+    pool = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT(pool != MAP_FAILED);
+
+    /* huge pages would fix the colour bits and defeat the purpose */
+    madvise(pool, len, MADV_NOHUGEPAGE);
+    memset(pool, 0x00, len);
+
+    return pool;
+}
+
+/*
+ * Lines are page-strided, so walking them in address order lets the stride
+ * prefetcher bring the next page's line (often the target) right back in.
+ */
+void pp_shuffle(char **lines, int n)
+{
+    char *tmp;
+    int i, j;
+
+    for (i=n-1; i > 0; i--)
+    {
+        j = rand() % (i+1);
+        tmp = lines[i];
+        lines[i] = lines[j];
+        lines[j] = tmp;
+    }
+}
+
+void pp_traverse(char **lines, int n)
+{
+    int i, r;
+
+    /* repeatedly, to push out lines kept by non-LRU replacement */
+    for (r=0; r < PP_PASSES; r++)
+        for (i=0; i < n; i++)
+            *(volatile char *) lines[i];
+}
+
+int pp_evicts(char *target, char **lines, int n)
+{
+    int i;
+
+    for (i=0; i < PP_TEST_REPS; i++)
+    {
+        *(volatile char *) target;
+        pp_traverse(lines, n);
+        PP_WARM_TLB(target);
+        if (reload(target) <= pp_threshold)
+            return 0;
+    }
+
+    return 1;
+}
+
+int pp_calibrate(char *pool, int pool_pages, cache_calib_t *c)
+{
+    int hit_hist[CALIB_BINS] = {0}, miss_hist[CALIB_BINS] = {0};
+    char **lines = malloc(pool_pages*sizeof(char*));
+    char *target = POOL_LINE(pool, 0);
+    int i, n, lat;
+
+    ASSERT(lines && pool_pages > PP_CALIB_SMALL);
+    for (i=1; i < pool_pages; i++)
+        lines[i-1] = POOL_LINE(pool, i);
+    pp_shuffle(lines, pool_pages-1);
+
+    for (i=0; i < PP_CALIB_SAMPLES; i++)
+    {
+        *(volatile char *) target;
+        pp_traverse(lines, PP_CALIB_SMALL);
+        PP_WARM_TLB(target);
+        lat = reload(target);
+        hit_hist[CALIB_BIN(lat)]++;
+
+        *(volatile char *) target;
+        pp_traverse(lines, pool_pages-1);
+        PP_WARM_TLB(target);
+        lat = reload(target);
+        miss_hist[CALIB_BIN(lat)]++;
+    }
+
+    calib_select_threshold(c, hit_hist, miss_hist, PP_CALIB_SAMPLES);
+
+    /*
+     * The evicted latency drifts a lot between runs (and is lower for a
+     * small set than for the whole pool), while requiring every timing of a
+     * test to be slow already suppresses noisy hits: so move the threshold
+     * down to just above the bulk of the hits.
+     */
+    for (i=0, n=0; i < CALIB_BINS && n < PP_CALIB_SAMPLES*PP_HIT_QUANTILE; i++)
+        n += hit_hist[i];
+    if (i < c->threshold)
+        c->threshold = i;
+
+    free(lines);
+    return pp_threshold = c->threshold;
+}
+
+/*
+ * Group-testing reduction (Vila et al., "Theory and practice of finding
+ * eviction sets", S&P 2019): split the set into ways+1 groups; at least one
+ * group can be dropped while the rest still evicts the target. This needs
+ * O(ways^2 * n) memory accesses instead of O(n^2) for one-by-one removal.
+ *
+ * A noisy test can wrongly accept a removal, after which no group can be
+ * dropped anymore. Removed groups are therefore kept behind the active part
+ * of the array, so the last one can be put back in place and the scan
+ * resumed with the next group (backtracking).
+ */
+int pp_reduce(char *target, char **lines, int n, int ways)
+{
+    char **tmp = malloc(n*sizeof(char*));
+    int *rm_lo = malloc(n*sizeof(int)), *rm_len = malloc(n*sizeof(int));
+    int *rm_g = malloc(n*sizeof(int));
+    int g, groups, lo, hi, m, found, depth = 0, first = 0, backtracks = 0;
+
+    ASSERT(tmp && rm_lo && rm_len && rm_g);
+    while (n > ways)
+    {
+        groups = (n < ways+1) ? n : ways+1;
+        for (g=first, found=0; g < groups && !found; g++)
+        {
+            lo = (g*n) / groups;
+            hi = ((g+1)*n) / groups;
+
+            /* [A G B] -> [A B G]: active part A B, group parked behind it */
+            memcpy(tmp, lines+lo, (hi-lo)*sizeof(char*));
+            memmove(lines+lo, lines+hi, (n-hi)*sizeof(char*));
+            memcpy(lines+n-(hi-lo), tmp, (hi-lo)*sizeof(char*));
+            m = n - (hi-lo);
+
+            if (pp_evicts(target, lines, m))
+            {
+                rm_lo[depth] = lo;
+                rm_len[depth] = hi-lo;
+                rm_g[depth++] = g;
+                n = m;
+                found = 1;
+            }
+            else
+            {
+                memmove(lines+hi, lines+lo, (n-hi)*sizeof(char*));
+                memcpy(lines+lo, tmp, (hi-lo)*sizeof(char*));
+            }
+        }
+        first = 0;
+
+        if (found)
+            continue;
+        if (!depth || backtracks++ >= PP_MAX_BACKTRACKS)
+            break;
+
+        /* undo the last removal: [A B G] -> [A G B], retry from group g+1 */
+        depth--;
+        lo = rm_lo[depth];
+        m = rm_len[depth];
+        memcpy(tmp, lines+n, m*sizeof(char*));
+        memmove(lines+lo+m, lines+lo, (n-lo)*sizeof(char*));
+        memcpy(lines+lo, tmp, m*sizeof(char*));
+        n += m;
+        first = rm_g[depth] + 1;
+    }
+
+    free(tmp);
+    free(rm_lo);
+    free(rm_len);
+    free(rm_g);
+    return n;
+}
+
+void pp_link(evset_t *s)
+{
+    int i;
+
+    /* next pointer at +0, previous pointer at +8 of every line */
+    for (i=0; i < s->len; i++)
+    {
+        *(char **) s->line[i] = (i+1 < s->len) ? s->line[i+1] : NULL;
+        *(char **) (s->line[i]+8) = (i > 0) ? s->line[i-1] : NULL;
+    }
+}
+
+int pp_build_evsets(char *pool, int pool_pages, int ways,
+                    evset_t *sets, int max_sets)
+{
+    char **cand = malloc(pool_pages*sizeof(char*));
+    char **work = malloc(pool_pages*sizeof(char*));
+    int i, j, n, ncand = pool_pages, nsets = 0, tries = 0, same;
+    char *target;
+    evset_t *s;
+
+    ASSERT(cand && work && ways <= PP_MAX_WAYS);
+    for (i=0; i < pool_pages; i++)
+        cand[i] = POOL_LINE(pool, i);
+    pp_shuffle(cand, pool_pages);
+
+    while (nsets < max_sets && ncand > ways && tries++ < PP_MAX_TRIES)
+    {
+        /* the target is consumed; if its colour is not represented often
+           enough in the remaining pool it simply gets dropped */
+        target = cand[--ncand];
+        memcpy(work, cand, ncand*sizeof(char*));
+        if (!pp_evicts(target, work, ncand))
+            continue;
+
+        /* a minimal set only evicts some of the time under non-LRU
+           replacement, so the reduction may stop a few lines short */
+        n = pp_reduce(target, work, ncand, ways);
+        if (n > PP_MAX_WAYS)
+        {
+            /* keep it, but do not pick the same target again right away */
+            j = rand() % (ncand+1);
+            cand[ncand++] = cand[j];
+            cand[j] = target;
+            continue;
+        }
+
+        s = &sets[nsets++];
+        s->len = n;
+        memcpy(s->line, work, n*sizeof(char*));
+        pp_link(s);
+
+        /* drop the set itself and every other candidate of its colour */
+        for (i=0; i < ncand; )
+        {
+            for (j=0, same=0; j < s->len && !same; j++)
+                same = (cand[i] == s->line[j]);
+
+            if (same || pp_evicts(cand[i], s->line, s->len))
+                cand[i] = cand[--ncand];
+            else
+                i++;
+        }
+    }
+
+    free(cand);
+    free(work);
+    return nsets;
+}
+
+int pp_build_evsets_phys(char *pool, int pool_pages, int ways,
+                         evset_t *sets, int max_sets)
+{
+    phys_info_t *info = malloc(pool_pages*sizeof(phys_info_t));
+    int colours = pp_l2_colours(), *set_of, i, col, nsets = 0;
+    phys_info_t *p;
+    char **cand;
+    evset_t *s;
+
+    ASSERT(info && ways <= PP_MAX_WAYS);
+    if (phys_init() < 0)
+    {
+        free(info);
+        return 0;
+    }
+    ASSERT(phys_query(pool, (size_t) pool_pages*PP_PAGE_SIZE, PP_PAGE_SIZE,
+                      info, pool_pages) == pool_pages);
+
+    /* set_of[col] is the eviction set being filled for that colour */
+    set_of = malloc(colours*sizeof(int));
+    cand = malloc(pool_pages*sizeof(char*));
+    ASSERT(set_of && cand);
+    for (col=0; col < colours; col++)
+        set_of[col] = -1;
+    for (i=0; i < pool_pages; i++)
+        cand[i] = POOL_LINE(pool, i);
+    pp_shuffle(cand, pool_pages);
+
+    for (i=0; i < pool_pages; i++)
+    {
+        /* info[] is in pool order, one entry per page */
+        p = &info[(cand[i] - pool) / PP_PAGE_SIZE];
+        if (!p->pa)
+            continue;
+        col = p->l2_set / (PP_PAGE_SIZE / PP_LINE_SIZE);
+        if (set_of[col] < 0)
+        {
+            if (nsets == max_sets)
+                continue;
+            set_of[col] = nsets;
+            sets[nsets++].len = 0;
+        }
+
+        s = &sets[set_of[col]];
+        if (s->len < ways)
+            s->line[s->len++] = cand[i];
+    }
+
+    /* colours the pool holds fewer than 'ways' pages of cannot be evicted */
+    for (i=0, col=0; i < nsets; i++)
+        if (sets[i].len == ways)
+        {
+            sets[col] = sets[i];
+            pp_link(&sets[col++]);
+        }
+
+    free(info);
+    free(set_of);
+    free(cand);
+    return col;
+}
+
+void pp_evset_shift(evset_t *src, evset_t *dst, int offset)
+{
+    int i;
+
+    dst->len = src->len;
+    for (i=0; i < src->len; i++)
+        dst->line[i] = (char *) ((uint64_t) src->line[i] & ~(PP_PAGE_SIZE-1)) + offset;
+    pp_link(dst);
+}
+
+void pp_prime(evset_t *s)
+{
+    char *p;
+    int r;
+
+    for (r=0; r < PP_PASSES; r++)
+    {
+        p = s->line[0];
+        asm volatile (
+        "1:\n\t"
+        "movq (%0), %0\n\t"
+        "testq %0, %0\n\t"
+        "jnz 1b\n\t"
+        : "+r" (p)
+        :
+        : "memory");
+    }
+}
+
+int pp_probe(evset_t *s)
+{
+    int lat;
+
+    pp_probe_batch(s, &lat, 1);
+    return lat;
+}
+
+/*
+ * Like reload_batch(), consecutive sets share their timestamps so the whole
+ * sweep runs inside a single serialized region.
+ */
+void pp_probe_batch(evset_t *sets, int *lat, int n)
+{
+    int i;
+
+    /* the asm reads len at offset 0 and finds line[len-1] at len*8 */
+    _Static_assert(offsetof(evset_t, len) == 0 && offsetof(evset_t, line) == 8,
+                   "pp_probe_batch assumes the evset_t layout");
+
+    if (n <= 0)
+        return;
+    for (i=0; i < n; i++)
+        ASSERT(sets[i].len > 0);
+
+    asm volatile (
+    "mfence\n\t"
+    "lfence\n\t"
+    "rdtsc\n\t"
+    "lfence\n\t"
+    "movl %%eax, %%r8d\n\t"
+    "1:\n\t"
+    "movslq (%0), %%rcx\n\t"
+    "movq (%0,%%rcx,8), %%rcx\n\t"      /* line[len-1] */
+    "2:\n\t"
+    "movq 8(%%rcx), %%rcx\n\t"
+    "testq %%rcx, %%rcx\n\t"
+    "jnz 2b\n\t"
+    "lfence\n\t"
+    "rdtsc\n\t"
+    "lfence\n\t"
+    "movl %%eax, %%r9d\n\t"
+    "subl %%r8d, %%eax\n\t"
+    "movl %%eax, (%1)\n\t"
+    "movl %%r9d, %%r8d\n\t"
+    "addq %3, %0\n\t"
+    "addq $4, %1\n\t"
+    "decl %2\n\t"
+    "jnz 1b\n\t"
+    : "+r" (sets), "+r" (lat), "+r" (n)
+    : "i" (sizeof(evset_t))
+    : "%rax", "%rcx", "%rdx", "%r8", "%r9", "memory");
+}
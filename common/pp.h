@@ -0,0 +1,76 @@
+#ifndef PP_H_INC
+#define PP_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cacheutils.h"
+
+/*
+ * Prime+Probe on the (non-hashed, physically indexed) L2 cache.
+ *
+ * Eviction sets are built from a pool of attacker-owned 4 KiB pages, whose
+ * physical "colour" (the set-index bits above the page offset) is unknown.
+ * Lines at the same page offset in two pages of the same colour are
+ * congruent for every offset, so one eviction set per colour is built at
+ * offset 0 and then shifted to any other line offset.
+ */
+#define PP_LINE_SIZE        64
+#define PP_PAGE_SIZE        0x1000
+#define PP_MAX_WAYS         32
+/*
+ * The L2 replacement policy is not LRU: with only 'ways' congruent lines,
+ * a couple of passes often leave the target (or the victim's line) cached.
+ */
+#define PP_PASSES           8
+
+typedef struct {
+    int len;
+    char *line[PP_MAX_WAYS];    /* pointer-chasing list through these */
+} evset_t;
+
+/* Attribute of the cpu0 cache at 'level' (L1 = data cache) from sysfs. */
+int pp_cache_attr(int level, const char *attr, int def);
+
+/* L2 geometry from sysfs (with sane fallbacks when unavailable). */
+int pp_l2_ways(void);
+int pp_l2_colours(void);
+
+/* Allocate a pool of candidate pages (4 KiB backed). */
+char *pp_alloc_pool(int pool_pages);
+
+/*
+ * Derive the "still in L2" vs. "evicted from L2" threshold used by the
+ * eviction tests; also returns the latency medians in *c.
+ */
+int pp_calibrate(char *pool, int pool_pages, cache_calib_t *c);
+
+/*
+ * Build up to max_sets eviction sets of 'ways' (at most PP_MAX_WAYS) lines
+ * each at page offset 0, one per distinct colour found in the pool, by
+ * group-testing reduction. Returns the number of sets built.
+ */
+int pp_build_evsets(char *pool, int pool_pages, int ways,
+                    evset_t *sets, int max_sets);
+
+/*
+ * Same, but group the pool pages by their colour as computed from physical
+ * addresses (see phys.h) instead of by timing. Needs a readable pagemap;
+ * returns 0 if it is not, so callers can fall back to pp_build_evsets().
+ */
+int pp_build_evsets_phys(char *pool, int pool_pages, int ways,
+                         evset_t *sets, int max_sets);
+
+/* Copy an eviction set to another line offset within the same pages. */
+void pp_evset_shift(evset_t *src, evset_t *dst, int offset);
+
+/* Prime all lines of the set (PP_PASSES forward chases). */
+void pp_prime(evset_t *s);
+
+/* Time a backward chase through the set; also re-primes it. */
+int pp_probe(evset_t *s);
+
+/* Probe n sets back to back, writing the latency of sets[i] into lat[i]. */
+void pp_probe_batch(evset_t *sets, int *lat, int n);
+
+#endif
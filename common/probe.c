@@ -0,0 +1,131 @@
+#include "debug.h"
+#include "probe.h"
+#include "xorshift.h"
+#include <string.h>
+#include <sys/mman.h>
+
+int probe_alloc(probe_buf_t *p, int nslots, size_t stride, int flags)
+{
+    size_t len = nslots * stride, lines = stride / PROBE_LINE_SIZE;
+    int *perm, k, j, t;
+    uint64_t x = xorshift_seed();
+    char *m;
+
+    memset(p, 0, sizeof(*p));
+    if (nslots <= 0 || stride < PROBE_LINE_SIZE || stride % PROBE_LINE_SIZE)
+        return -1;
+
+    p->nslots = nslots;
+    p->stride = stride;
+    p->backing = PROBE_BACKING_4K;
+
+    if (flags & PROBE_HUGE)
+    {
+        len = (len + PROBE_HUGE_SIZE-1) & ~(size_t) (PROBE_HUGE_SIZE-1);
+        m = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (m != MAP_FAILED)
+        {
+            p->map = p->base = m;
+            p->map_len = p->len = len;
+            p->backing = PROBE_BACKING_HUGETLB;
+        }
+        else
+        {
+            /* no reserved huge pages: ask for transparent ones */
+            m = mmap(NULL, len + PROBE_HUGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m == MAP_FAILED)
+                return -1;
+            p->map = m;
+            p->map_len = len + PROBE_HUGE_SIZE;
+            p->base = (char *) (((uint64_t) m + PROBE_HUGE_SIZE-1) &
+                                ~(uint64_t) (PROBE_HUGE_SIZE-1));
+            p->len = len;
+            madvise(p->base, len, MADV_HUGEPAGE);
+            p->backing = PROBE_BACKING_THP;
+        }
+    }
+    else
+    {
+        m = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED)
+            return -1;
+        madvise(m, len, MADV_NOHUGEPAGE);
+        p->map = p->base = m;
+        p->map_len = p->len = len;
+    }
+
+    /* populate (and, with THP, fault in whole huge pages) */
+    memset(p->base, 1, p->len);
+
+    ASSERT((p->slot = malloc(nslots * sizeof(void *))));
+    ASSERT((perm = malloc(nslots * sizeof(int))));
+    for (k=0; k < nslots; k++)
+        perm[k] = k;
+
+    if (flags & PROBE_RANDOM)
+        for (k=nslots-1; k > 0; k--)
+        {
+            j = xorshift(&x) % (k+1);
+            t = perm[k]; perm[k] = perm[j]; perm[j] = t;
+        }
+
+    for (k=0; k < nslots; k++)
+    {
+        p->slot[k] = p->base + perm[k] * stride;
+        if (flags & PROBE_RANDOM)
+            p->slot[k] = (char *) p->slot[k] +
+                         (xorshift(&x) % lines) * PROBE_LINE_SIZE;
+    }
+
+    free(perm);
+    return 0;
+}
+
+void probe_free(probe_buf_t *p)
+{
+    if (p->map)
+        munmap(p->map, p->map_len);
+    free(p->slot);
+    memset(p, 0, sizeof(*p));
+}
+
+size_t probe_huge_kb(probe_buf_t *p)
+{
+    uint64_t lo, hi, start = (uint64_t) p->base, end = start + p->len;
+    size_t kb, total = 0;
+    char line[256];
+    int in = 0;
+    FILE *f;
+
+    if (p->backing == PROBE_BACKING_HUGETLB)
+        return p->len / 1024;
+    if (!(f = fopen("/proc/self/smaps", "r")))
+        return 0;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "%lx-%lx", &lo, &hi) == 2 && strchr(line, '-') < strchr(line, ' '))
+            in = (lo < end && hi > start);
+        else if (in && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+            total += kb;
+    }
+
+    fclose(f);
+    return total;
+}
+
+const char *probe_backing_name(probe_buf_t *p)
+{
+    switch (p->backing)
+    {
+        case PROBE_BACKING_HUGETLB:
+            return "hugetlb";
+        case PROBE_BACKING_THP:
+            return "thp";
+        default:
+            return "4k";
+    }
+}
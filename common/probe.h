@@ -0,0 +1,51 @@
+#ifndef PROBE_H_INC
+#define PROBE_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Probe-memory allocator for the cache experiments.
+ *
+ * probe_alloc() reserves nslots slots of 'stride' bytes. With PROBE_HUGE the
+ * region is backed by 2 MiB pages: hugetlbfs (MAP_HUGETLB) when pages are
+ * reserved, else a 2 MiB-aligned anonymous mapping with MADV_HUGEPAGE
+ * (transparent huge pages); without it, THP is explicitly disabled so the
+ * slots really sit on 4 KiB pages. All pages are populated up front.
+ *
+ * With PROBE_RANDOM, the slot layout is randomized per allocation: slot k is
+ * placed at a random position (a permutation of 0..nslots-1) and at a random
+ * cache-line offset within its stride, so neither the memory order of the
+ * slots nor their cache-set index follows the slot number. Use slot[k] to
+ * address slot k; only unrandomized buffers can be indexed as base+k*stride.
+ */
+#define PROBE_HUGE          0x1
+#define PROBE_RANDOM        0x2
+
+#define PROBE_LINE_SIZE     64
+#define PROBE_HUGE_SIZE     0x200000
+
+#define PROBE_BACKING_4K        0
+#define PROBE_BACKING_HUGETLB   1
+#define PROBE_BACKING_THP       2
+
+typedef struct {
+    char *base;
+    size_t len;             /* of the mapping at base */
+    void *map;              /* as returned by mmap (THP: before alignment) */
+    size_t map_len;
+    int nslots;
+    size_t stride;
+    int backing;
+    void **slot;            /* address of slot k */
+} probe_buf_t;
+
+int probe_alloc(probe_buf_t *p, int nslots, size_t stride, int flags);
+void probe_free(probe_buf_t *p);
+
+/* kB of the buffer currently backed by huge pages (from /proc/self/smaps) */
+size_t probe_huge_kb(probe_buf_t *p);
+const char *probe_backing_name(probe_buf_t *p);
+
+#endif
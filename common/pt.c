@@ -0,0 +1,128 @@
+#include "pt.h"
+#include "pf.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/* Fibonacci hashing of the page frame number */
+static inline unsigned int pt_hash(void *page)
+{
+    return ((((uint64_t) page) >> 12) * 0x9e3779b97f4a7c15ull) >>
+           (64 - __builtin_ctz(PT_HASH_SIZE));
+}
+
+void pt_init(pt_ctl_t *c, int window, int *trace, int trace_max)
+{
+    memset(c, 0, sizeof(*c));
+    c->window = (window < 1) ? 1 :
+                (window > PT_MAX_WINDOW) ? PT_MAX_WINDOW : window;
+    c->trace = trace;
+    c->trace_max = trace_max;
+}
+
+pt_entry_t *pt_lookup(pt_ctl_t *c, void *adrs)
+{
+    void *page = GET_PFN(adrs);
+    unsigned int i = pt_hash(page);
+
+    /* linear probing; the table is at most half full */
+    for (; c->slot[i].page; i = (i+1) & (PT_HASH_SIZE-1))
+        if (c->slot[i].page == page)
+            return &c->slot[i];
+
+    return NULL;
+}
+
+int pt_add(pt_ctl_t *c, void *adrs, int id, int prot)
+{
+    void *page = GET_PFN(adrs);
+    unsigned int i = pt_hash(page);
+
+    if (c->npages >= PT_MAX_PAGES || pt_lookup(c, page))
+        return -1;
+
+    while (c->slot[i].page)
+        i = (i+1) & (PT_HASH_SIZE-1);
+
+    c->slot[i].page = page;
+    c->slot[i].id = id;
+    c->slot[i].prot = prot;
+    c->npages++;
+    return 0;
+}
+
+void pt_arm(pt_ctl_t *c)
+{
+    int i;
+
+    for (i=0; i < PT_HASH_SIZE; i++)
+        if (c->slot[i].page)
+        {
+            pf_protect(c->slot[i].page, PROT_NONE);
+            c->slot[i].is_open = 0;
+        }
+
+    c->nopen = c->oldest = 0;
+    c->trace_len = 0;
+    c->unknown = c->refaults = 0;
+}
+
+void pt_disarm(pt_ctl_t *c)
+{
+    int i;
+
+    for (i=0; i < PT_HASH_SIZE; i++)
+        if (c->slot[i].page)
+        {
+            pf_protect(c->slot[i].page, c->slot[i].prot);
+            c->slot[i].is_open = 0;
+        }
+
+    c->nopen = c->oldest = 0;
+}
+
+int pt_fault(pt_ctl_t *c, void *page)
+{
+    pt_entry_t *e = pt_lookup(c, page);
+    int last;
+
+    if (!e)
+    {
+        c->unknown++;
+        return -1;
+    }
+
+    if (c->trace_len < c->trace_max)
+        c->trace[c->trace_len++] = e->id;
+
+    /*
+     * Already in the window: the access needs more than e->prot (e.g., a
+     * read of a PROT_EXEC page, which is execute-only with protection
+     * keys). Re-applying e->prot would fault forever, so widen it (read
+     * first, then write) and count the fault; a second FIFO entry would
+     * shrink the window.
+     */
+    if (e->is_open)
+    {
+        c->refaults++;
+        e->prot |= (e->prot & PROT_READ) ? PROT_WRITE : PROT_READ;
+        pf_protect(e->page, e->prot);
+        return e->id;
+    }
+
+    /* close the oldest open page to make room in the window */
+    if (c->nopen == c->window)
+    {
+        pf_protect(c->open[c->oldest]->page, PROT_NONE);
+        c->open[c->oldest]->is_open = 0;
+        c->oldest = (c->oldest + 1) % c->window;
+        c->nopen--;
+    }
+
+    pf_protect(e->page, e->prot);
+    last = (c->oldest + c->nopen) % c->window;
+    c->open[last] = e;
+    e->is_open = 1;
+    c->nopen++;
+
+    return e->id;
+}
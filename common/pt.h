@@ -0,0 +1,74 @@
+#ifndef PT_H_INC
+#define PT_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Table-driven page-transition controller for fault-sequence tracing.
+ *
+ * The driver registers the pages to trace, each with an id and the access
+ * rights it needs while "open" (e.g., PROT_EXEC for code), and arms the
+ * controller, which revokes access to all of them. From the fault handler,
+ * pt_fault() looks the faulting page up in an open-addressing hash table,
+ * appends its id to the trace, opens it, and closes the oldest open page once
+ * more than 'window' pages are open. The cost per fault is thus O(1) and
+ * independent of the number of traced pages: one lookup plus (at most) two
+ * protection changes.
+ *
+ * A page that faults again while open needed more than its registered
+ * rights: pt_fault() then widens them for good and counts the fault in
+ * 'refaults'.
+ *
+ * With window = 1 every transition between traced pages faults; a larger
+ * window hides transitions among the last 'window' pages, trading trace
+ * detail for fewer faults.
+ */
+#define PT_MAX_PAGES        1024
+#define PT_HASH_SIZE        (2*PT_MAX_PAGES)    /* power of two */
+#define PT_MAX_WINDOW       16
+
+typedef struct {
+    void *page;             /* NULL for an empty slot */
+    int id;
+    int prot;               /* access rights while open */
+    int is_open;            /* currently in the window */
+} pt_entry_t;
+
+typedef struct {
+    pt_entry_t slot[PT_HASH_SIZE];
+    int npages;
+    int window;
+    pt_entry_t *open[PT_MAX_WINDOW];    /* FIFO of open pages */
+    int nopen;
+    int oldest;
+    int *trace;             /* ids of the faulting pages, in order */
+    int trace_len;
+    int trace_max;
+    uint64_t unknown;       /* faults on pages that are not traced */
+    uint64_t refaults;      /* faults on open pages (their rights widened) */
+} pt_ctl_t;
+
+/* Record at most trace_max ids in trace[] (further faults are not logged). */
+void pt_init(pt_ctl_t *c, int window, int *trace, int trace_max);
+
+/* Trace the page holding adrs; returns 0 on success. */
+int pt_add(pt_ctl_t *c, void *adrs, int id, int prot);
+
+/* Revoke access to all traced pages and restart the trace. */
+void pt_arm(pt_ctl_t *c);
+
+/* Restore the open access rights of all traced pages. */
+void pt_disarm(pt_ctl_t *c);
+
+/*
+ * Handle a fault on page base address 'page'; returns the page's id, or -1
+ * if it is not traced (its access rights are then left unchanged).
+ */
+int pt_fault(pt_ctl_t *c, void *page);
+
+/* Entry of the traced page holding adrs, or NULL. */
+pt_entry_t *pt_lookup(pt_ctl_t *c, void *adrs);
+
+#endif
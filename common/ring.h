@@ -0,0 +1,61 @@
+#ifndef RING_H_INC
+#define RING_H_INC
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring.
+ *
+ * RING_DEFINE(name, type, size) defines a ring of 'size' (a power of two)
+ * elements of 'type' as name_t, with name_init(), name_push() and
+ * name_pop(). The producer never blocks: when the consumer falls behind,
+ * elements are dropped and counted in 'dropped', so that push is safe to
+ * call from a signal handler. head and tail live on their own cache lines,
+ * so the two sides only share a line when one actually reads the other's
+ * index.
+ */
+#define RING_DEFINE(name, type, size)                                         \
+typedef struct {                                                              \
+    uint64_t head __attribute__((aligned(64)));     /* written by producer */ \
+    uint64_t dropped;                                                         \
+    uint64_t tail __attribute__((aligned(64)));     /* written by consumer */ \
+    type ev[size] __attribute__((aligned(64)));                               \
+} name##_t;                                                                   \
+                                                                              \
+static inline void name##_init(name##_t *r)                                   \
+{                                                                             \
+    memset(r, 0, sizeof(*r));                                                 \
+}                                                                             \
+                                                                              \
+static inline int name##_push(name##_t *r, const type *e)                     \
+{                                                                             \
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);              \
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);              \
+                                                                              \
+    if (head - tail >= (size))                                                \
+    {                                                                         \
+        __atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);                 \
+        return -1;                                                            \
+    }                                                                         \
+                                                                              \
+    r->ev[head & ((size)-1)] = *e;                                            \
+    __atomic_store_n(&r->head, head+1, __ATOMIC_RELEASE);                     \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+/* pops up to max elements into out; returns how many */                     \
+static inline int name##_pop(name##_t *r, type *out, int max)                 \
+{                                                                             \
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);              \
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);              \
+    int n;                                                                    \
+                                                                              \
+    for (n=0; n < max && tail != head; n++, tail++)                           \
+        out[n] = r->ev[tail & ((size)-1)];                                    \
+                                                                              \
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);                       \
+    return n;                                                                 \
+}
+
+#endif
@@ -0,0 +1,201 @@
+#include "sd.h"
+#include "debug.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include <linux/fs.h>
+
+/* PAGEMAP_SCAN ABI (linux/fs.h since 6.7), for older installed headers */
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WRITTEN             (1 << 1)
+#define PM_SCAN_WP_MATCHING         (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC       (1 << 1)
+
+struct page_region {
+    uint64_t start;
+    uint64_t end;
+    uint64_t categories;
+};
+
+struct pm_scan_arg {
+    uint64_t size;
+    uint64_t flags;
+    uint64_t start;
+    uint64_t end;
+    uint64_t walk_end;
+    uint64_t vec;
+    uint64_t vec_len;
+    uint64_t max_pages;
+    uint64_t category_inverted;
+    uint64_t category_mask;
+    uint64_t category_anyof_mask;
+    uint64_t return_mask;
+};
+
+#define PAGEMAP_SCAN                _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#define UFFD_FEATURE_WP_ASYNC       (1 << 15)
+#endif
+
+static uint64_t sd_pagemap_entry(int pagemap_fd, void *page)
+{
+    uint64_t e = 0;
+    off_t off = ((uint64_t) page / SD_PAGE_SIZE) * sizeof(uint64_t);
+
+    ASSERT(pread(pagemap_fd, &e, sizeof(e), off) == sizeof(e));
+    return e;
+}
+
+/* Soft-dirty bits are only tracked with CONFIG_MEM_SOFT_DIRTY; try it out. */
+static int sd_softdirty_works(int clear_fd, int pagemap_fd)
+{
+    volatile char *p;
+    int rv;
+
+    p = mmap(NULL, SD_PAGE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT(p != MAP_FAILED);
+
+    p[0] = 1;
+    ASSERT(pwrite(clear_fd, "4", 1, 0) == 1);
+    p[0] = 2;
+    rv = !!(sd_pagemap_entry(pagemap_fd, (void *) p) & SD_PAGEMAP_DIRTY);
+
+    munmap((void *) p, SD_PAGE_SIZE);
+    return rv;
+}
+
+static int sd_written_init(sd_tracker_t *t)
+{
+    struct uffdio_api api = { .api = UFFD_API,
+        .features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED };
+    struct uffdio_register reg;
+
+    if ((t->fd = syscall(SYS_userfaultfd, O_CLOEXEC)) < 0 ||
+        ioctl(t->fd, UFFDIO_API, &api))
+        return -1;
+
+    reg.range.start = (uint64_t) t->base;
+    reg.range.len = (uint64_t) t->npages * SD_PAGE_SIZE;
+    reg.mode = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl(t->fd, UFFDIO_REGISTER, &reg))
+        return -1;
+
+    return (t->regions = calloc(t->npages, sizeof(struct page_region))) ? 0 : -1;
+}
+
+int sd_init(sd_tracker_t *t, void *adrs, size_t len)
+{
+    uint64_t start = (uint64_t) adrs & ~(uint64_t) (SD_PAGE_SIZE-1);
+    uint64_t end = ((uint64_t) adrs + len + SD_PAGE_SIZE-1) &
+                   ~(uint64_t) (SD_PAGE_SIZE-1);
+
+    memset(t, 0, sizeof(*t));
+    t->base = (char *) start;
+    t->npages = (end - start) / SD_PAGE_SIZE;
+    t->fd = open("/proc/self/clear_refs", O_WRONLY);
+    t->pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    t->entries = calloc(t->npages, sizeof(uint64_t));
+
+    if (t->fd < 0 || t->pagemap_fd < 0 || !t->entries)
+        goto fail;
+
+    t->mode = SD_MODE_SOFTDIRTY;
+    if (!sd_softdirty_works(t->fd, t->pagemap_fd))
+    {
+        close(t->fd);
+        t->mode = SD_MODE_WRITTEN;
+        if (sd_written_init(t))
+            goto fail;
+    }
+
+    sd_clear(t);
+    return 0;
+
+fail:
+    sd_destroy(t);
+    return -1;
+}
+
+void sd_destroy(sd_tracker_t *t)
+{
+    if (t->fd >= 0)
+        close(t->fd);
+    if (t->pagemap_fd >= 0)
+        close(t->pagemap_fd);
+    free(t->entries);
+    free(t->regions);
+    t->fd = t->pagemap_fd = -1;
+    t->entries = t->regions = NULL;
+}
+
+void sd_clear(sd_tracker_t *t)
+{
+    struct pm_scan_arg arg;
+
+    if (t->mode == SD_MODE_SOFTDIRTY)
+    {
+        ASSERT(pwrite(t->fd, "4", 1, 0) == 1);
+        return;
+    }
+
+    /* write-protect the range again, without reporting anything */
+    memset(&arg, 0, sizeof(arg));
+    arg.size = sizeof(arg);
+    arg.flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC;
+    arg.start = (uint64_t) t->base;
+    arg.end = arg.start + (uint64_t) t->npages * SD_PAGE_SIZE;
+    arg.category_mask = PAGE_IS_WRITTEN;
+    ASSERT(ioctl(t->pagemap_fd, PAGEMAP_SCAN, &arg) >= 0);
+}
+
+/* One PAGEMAP_SCAN returns the written pages as runs [start, end). */
+static void sd_scan_written(sd_tracker_t *t)
+{
+    struct page_region *r = t->regions;
+    struct pm_scan_arg arg;
+    uint64_t p;
+    int i, n;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.size = sizeof(arg);
+    arg.start = (uint64_t) t->base;
+    arg.end = arg.start + (uint64_t) t->npages * SD_PAGE_SIZE;
+    arg.vec = (uint64_t) r;
+    arg.vec_len = t->npages;
+    arg.category_mask = PAGE_IS_WRITTEN;
+    arg.return_mask = PAGE_IS_WRITTEN;
+    ASSERT((n = ioctl(t->pagemap_fd, PAGEMAP_SCAN, &arg)) >= 0);
+
+    memset(t->entries, 0, t->npages * sizeof(uint64_t));
+    for (i=0; i < n; i++)
+        for (p = r[i].start; p < r[i].end; p += SD_PAGE_SIZE)
+            t->entries[(p - arg.start) / SD_PAGE_SIZE] = SD_PAGEMAP_DIRTY;
+}
+
+int sd_scan(sd_tracker_t *t, uint8_t *dirty)
+{
+    size_t len = t->npages * sizeof(uint64_t);
+    off_t off = ((uint64_t) t->base / SD_PAGE_SIZE) * sizeof(uint64_t);
+    int i, n = 0;
+
+    if (t->mode == SD_MODE_SOFTDIRTY)
+        ASSERT((size_t) pread(t->pagemap_fd, t->entries, len, off) == len);
+    else
+        sd_scan_written(t);
+
+    for (i=0; i < t->npages; i++)
+    {
+        if (dirty)
+            dirty[i] = SD_IS_DIRTY(t, i);
+        n += SD_IS_DIRTY(t, i);
+    }
+    return n;
+}
@@ -0,0 +1,57 @@
+#ifndef SD_H_INC
+#define SD_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Fault-free write tracking: which of a range of pages were written since
+ * the last sd_clear()? The victim runs without any signal or protection
+ * change visible to user space, and one system call answers the question
+ * for the whole range. Reads are invisible; the granularity is 4 KiB.
+ *
+ * SD_MODE_SOFTDIRTY uses the kernel's soft-dirty PTE bits: writing "4" to
+ * /proc/self/clear_refs clears them (for the whole process), and the first
+ * write to a page sets bit 55 of its /proc/self/pagemap entry again, which
+ * is read back with a single pread() over the range.
+ *
+ * Kernels built without CONFIG_MEM_SOFT_DIRTY never set that bit. There,
+ * sd_init() falls back to SD_MODE_WRITTEN: the range is registered with an
+ * asynchronous userfaultfd write-protection (resolved in the kernel, so no
+ * faults reach user space), and the PAGEMAP_SCAN ioctl (Linux 6.7+) reports
+ * and re-protects the written pages. This mode needs anonymous memory.
+ */
+#define SD_PAGE_SIZE        0x1000
+#define SD_PAGEMAP_DIRTY    (1ull << 55)
+
+enum { SD_MODE_SOFTDIRTY, SD_MODE_WRITTEN };
+
+typedef struct {
+    char *base;             /* first tracked page */
+    int npages;
+    int mode;
+    int fd;                 /* clear_refs, or the userfaultfd */
+    int pagemap_fd;
+    uint64_t *entries;      /* per page; SD_PAGEMAP_DIRTY is valid in both modes */
+    void *regions;          /* PAGEMAP_SCAN output (SD_MODE_WRITTEN) */
+} sd_tracker_t;
+
+/* Track the pages overlapping [adrs, adrs+len); returns 0 on success. */
+int sd_init(sd_tracker_t *t, void *adrs, size_t len);
+void sd_destroy(sd_tracker_t *t);
+
+/* Reset the written state of the tracked pages. */
+void sd_clear(sd_tracker_t *t);
+
+/*
+ * Fetch the state of all tracked pages in one pass and mark the pages
+ * written since the last sd_clear() in dirty[] (npages bytes, may be NULL).
+ * Returns the number of written pages.
+ */
+int sd_scan(sd_tracker_t *t, uint8_t *dirty);
+
+/* Written state of tracked page i as of the last sd_scan(). */
+#define SD_IS_DIRTY(t, i)   (!!((t)->entries[i] & SD_PAGEMAP_DIRTY))
+
+#endif
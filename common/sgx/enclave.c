@@ -0,0 +1,158 @@
+#include "debug.h"
+#include "enclave.h"
+#include "switchless.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    sgx_enclave_id_t eid;
+    char path[ENCLAVE_PATH_MAX];
+    int flags;
+    int refs;
+    int alive;
+    double create_ms;
+} enclave_t;
+
+enclave_t enclaves[ENCLAVE_MAX];
+int enclave_atexit = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int token_load(const char *file, sgx_launch_token_t *token)
+{
+    FILE *f;
+    size_t n;
+
+    memset(token, 0, sizeof(*token));
+    if (!(f = fopen(file, "rb")))
+        return 0;
+    n = fread(token, 1, sizeof(*token), f);
+    fclose(f);
+
+    /* a truncated token is as good as none */
+    if (n != sizeof(*token))
+    {
+        memset(token, 0, sizeof(*token));
+        return 0;
+    }
+    return 1;
+}
+
+static void token_save(const char *file, sgx_launch_token_t *token)
+{
+    FILE *f;
+
+    if (!(f = fopen(file, "wb")) || fwrite(token, sizeof(*token), 1, f) != 1)
+        info("WARNING: could not cache launch token in '%s'", file);
+    if (f)
+        fclose(f);
+}
+
+static enclave_t *enclave_find(sgx_enclave_id_t eid)
+{
+    int i;
+
+    for (i=0; i < ENCLAVE_MAX; i++)
+        if (enclaves[i].alive && enclaves[i].eid == eid)
+            return &enclaves[i];
+    return NULL;
+}
+
+sgx_enclave_id_t enclave_open(const char *path, int flags)
+{
+    char token_file[ENCLAVE_PATH_MAX + 8];
+    sgx_launch_token_t token;
+    int updated = 0, cached, i;
+    enclave_t *e = NULL;
+    double start;
+
+    ASSERT(strlen(path) < ENCLAVE_PATH_MAX);
+    for (i=0; i < ENCLAVE_MAX; i++)
+    {
+        if (enclaves[i].alive && enclaves[i].flags == flags &&
+            !strcmp(enclaves[i].path, path))
+        {
+            enclaves[i].refs++;
+            info("reusing enclave '%s' (eid=%#lx)", path,
+                 (unsigned long) enclaves[i].eid);
+            return enclaves[i].eid;
+        }
+        if (!e && !enclaves[i].alive)
+            e = &enclaves[i];
+    }
+    ASSERT(e);
+
+    snprintf(token_file, sizeof(token_file), "%s.token", path);
+    cached = token_load(token_file, &token);
+
+    info_event("Creating enclave%s...",
+               (flags & ENCLAVE_SWITCHLESS) ? " (switchless)" : "");
+    start = now_ms();
+    if (flags & ENCLAVE_SWITCHLESS)
+    {
+        SGX_ASSERT( sgx_create_enclave_switchless( path, /*debug=*/1,
+                                    &token, &updated, &e->eid ) );
+    }
+    else
+    {
+        SGX_ASSERT( sgx_create_enclave( path, /*debug=*/1,
+                                    &token, &updated, &e->eid, NULL ) );
+    }
+    e->create_ms = now_ms() - start;
+
+    if (updated)
+        token_save(token_file, &token);
+    info("enclave '%s' created in %.2f ms (launch token: %s)", path,
+         e->create_ms, !cached ? "none" : updated ? "refreshed" : "cached");
+
+    strcpy(e->path, path);
+    e->flags = flags;
+    e->refs = 1;
+    e->alive = 1;
+
+    if (!enclave_atexit)
+    {
+        atexit(enclave_close_all);
+        enclave_atexit = 1;
+    }
+    return e->eid;
+}
+
+static void enclave_destroy(enclave_t *e)
+{
+    SGX_ASSERT( sgx_destroy_enclave( e->eid ) );
+    e->alive = 0;
+}
+
+void enclave_close(sgx_enclave_id_t eid)
+{
+    enclave_t *e = enclave_find(eid);
+
+    ASSERT(e && e->refs > 0);
+    if (!--e->refs && !(e->flags & ENCLAVE_PERSIST))
+        enclave_destroy(e);
+}
+
+void enclave_close_all(void)
+{
+    int i;
+
+    for (i=0; i < ENCLAVE_MAX; i++)
+        if (enclaves[i].alive)
+            enclave_destroy(&enclaves[i]);
+}
+
+double enclave_create_ms(sgx_enclave_id_t eid)
+{
+    enclave_t *e = enclave_find(eid);
+
+    ASSERT(e);
+    return e->create_ms;
+}
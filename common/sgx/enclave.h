@@ -0,0 +1,41 @@
+#ifndef SGX_ENCLAVE_H_INC
+#define SGX_ENCLAVE_H_INC
+
+#include <sgx_urts.h>
+
+/*
+ * Shared enclave bootstrap for the SGX drivers.
+ *
+ * enclave_open() creates the enclave at 'path' (always in debug mode), or
+ * returns the instance that is already alive for the same path and flags.
+ * The launch token is cached next to the enclave ("<path>.token") and
+ * written back whenever the SDK updates it, so later runs start from a valid
+ * token (on platforms with flexible launch control the SDK ignores tokens).
+ * The creation time is reported and kept per enclave.
+ *
+ * enclave_close() drops a reference; the last one destroys the enclave
+ * unless it was opened with ENCLAVE_PERSIST, in which case it stays alive
+ * for the next enclave_open() of a long-running driver and is only
+ * destroyed at exit.
+ */
+#define ENCLAVE_SWITCHLESS      0x1     /* see switchless.h */
+#define ENCLAVE_PERSIST         0x2
+
+#define ENCLAVE_MAX             8
+#define ENCLAVE_PATH_MAX        256
+
+/* the build flavour selected in the Makefile (make SWITCHLESS=1) */
+#ifdef SGX_SWITCHLESS
+#define ENCLAVE_DEFAULT_FLAGS   ENCLAVE_SWITCHLESS
+#else
+#define ENCLAVE_DEFAULT_FLAGS   0
+#endif
+
+sgx_enclave_id_t enclave_open(const char *path, int flags);
+void enclave_close(sgx_enclave_id_t eid);
+void enclave_close_all(void);
+
+/* wall-clock time sgx_create_enclave took for this instance, in ms */
+double enclave_create_ms(sgx_enclave_id_t eid);
+
+#endif
@@ -0,0 +1,62 @@
+#include "debug.h"
+#include "mt.h"
+#include "cacheutils.h"
+#include <time.h>
+
+typedef struct {
+    mt_fn_t fn;
+    void *arg;
+    int id;
+    int cpu;
+    pthread_t thread;
+} mt_thread_t;
+
+pthread_barrier_t mt_start;
+
+static void *mt_main(void *p)
+{
+    mt_thread_t *t = p;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(t->cpu, &set);
+    ASSERT(!sched_setaffinity(0, sizeof(set), &set));
+
+    pthread_barrier_wait(&mt_start);
+    t->fn(t->arg, t->id);
+    return NULL;
+}
+
+int mt_run(int k, mt_fn_t fn, void *args, size_t stride, double *secs)
+{
+    mt_thread_t threads[MT_MAX_THREADS];
+    int cpus[MT_MAX_THREADS], n, i;
+    struct timespec t1, t2;
+
+    ASSERT((n = physical_cores(cpus, MT_MAX_THREADS)) > 0);
+    if (k > 0 && k < n)
+        n = k;
+    if (k > n)
+        info("WARNING: %d thread(s) requested, only %d core(s) available", k, n);
+
+    ASSERT(!pthread_barrier_init(&mt_start, NULL, n+1));
+    for (i=0; i < n; i++)
+    {
+        threads[i].fn = fn;
+        threads[i].arg = (char *) args + i*stride;
+        threads[i].id = i;
+        threads[i].cpu = cpus[i];
+        ASSERT(!pthread_create(&threads[i].thread, NULL, mt_main, &threads[i]));
+    }
+
+    pthread_barrier_wait(&mt_start);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (i=0; i < n; i++)
+        ASSERT(!pthread_join(threads[i].thread, NULL));
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    pthread_barrier_destroy(&mt_start);
+
+    if (secs)
+        *secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+    return n;
+}
@@ -0,0 +1,25 @@
+#ifndef SGX_MT_H_INC
+#define SGX_MT_H_INC
+
+#include <stddef.h>
+
+/*
+ * Concurrent enclave sampling: mt_run() starts k untrusted threads, each
+ * pinned to its own physical core (k = 0: one per core), releases them
+ * together, and waits until all of them returned from fn.
+ *
+ * Thread i gets args + i*stride, so each thread fills its own (cache-line
+ * or page aligned) result slot and the caller merges the slots afterwards:
+ * there is no shared state or lock on the sampling path. Every thread that
+ * is inside an ECALL occupies a TCS of its own, so the enclave's TCSNum
+ * must be at least MT_MAX_THREADS (plus the trusted switchless workers).
+ */
+#define MT_MAX_THREADS      8
+
+typedef void (*mt_fn_t)(void *arg, int id);
+
+/* returns the number of threads used; *secs receives the wall-clock time
+   from the common start to the last thread finishing */
+int mt_run(int k, mt_fn_t fn, void *args, size_t stride, double *secs);
+
+#endif
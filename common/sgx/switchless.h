@@ -0,0 +1,37 @@
+#ifndef SGX_SWITCHLESS_H_INC
+#define SGX_SWITCHLESS_H_INC
+
+#include <sgx_urts.h>
+#include <sgx_uswitchless.h>
+
+/*
+ * Switchless calls (Intel SGX SDK 2.2+): ECALLs marked
+ * 'transition_using_threads' in the EDL are put in a shared request queue
+ * and executed by trusted worker threads that stay inside the enclave, so
+ * the caller does not pay for EENTER/EEXIT. The enclave must import
+ * "sgx_tswitchless.edl" and be linked with sgx_tswitchless (the application
+ * with sgx_uswitchless), and its TCSNum must cover the trusted workers plus
+ * the calling thread(s). Enclaves created with plain sgx_create_enclave()
+ * execute the same ECALLs as ordinary ones.
+ *
+ * The workers busy-wait, so they need cores of their own to pay off.
+ */
+#define SWITCHLESS_UWORKERS     1
+#define SWITCHLESS_TWORKERS     1
+
+static inline sgx_status_t sgx_create_enclave_switchless(const char *path,
+        int debug, sgx_launch_token_t *token, int *updated,
+        sgx_enclave_id_t *eid)
+{
+    static sgx_uswitchless_config_t cfg = SGX_USWITCHLESS_CONFIG_INITIALIZER;
+    const void *ex[32] = { 0 };
+
+    cfg.num_uworkers = SWITCHLESS_UWORKERS;
+    cfg.num_tworkers = SWITCHLESS_TWORKERS;
+    ex[SGX_CREATE_ENCLAVE_EX_SWITCHLESS_BIT_IDX] = &cfg;
+
+    return sgx_create_enclave_ex(path, debug, token, updated, eid, NULL,
+                                 SGX_CREATE_ENCLAVE_EX_SWITCHLESS, ex);
+}
+
+#endif
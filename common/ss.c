@@ -0,0 +1,78 @@
+#include "ss.h"
+#include "pf.h"
+#include "debug.h"
+#include <signal.h>
+#include <string.h>
+
+uint64_t ss_lo = 0, ss_hi = 0;
+int ss_armed = 0;
+/* address of the instruction the next trap reports as executed */
+uint64_t ss_prev_rip = 0;
+volatile uint64_t ss_count = 0;
+
+#define SS_IN_RANGE(rip)    ((rip) >= ss_lo && (rip) < ss_hi)
+
+void ss_trap_handler(int signo, siginfo_t *si, void *ctx)
+{
+    ucontext_t *uc = (ucontext_t *) ctx;
+    uint64_t rip = uc->uc_mcontext.gregs[REG_RIP];
+
+    /* the trap is taken after the instruction at ss_prev_rip completed */
+    if (SS_IN_RANGE(ss_prev_rip))
+        ss_count++;
+    ss_prev_rip = rip;
+
+    if (!ss_armed || !SS_IN_RANGE(rip))
+        uc->uc_mcontext.gregs[REG_EFL] &= ~SS_TF;
+}
+
+void ss_init(void)
+{
+    struct sigaction act;
+
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = ss_trap_handler;
+    act.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigfillset(&act.sa_mask);
+
+    ASSERT(!sigaction(SIGTRAP, &act, NULL));
+}
+
+void ss_arm(void *lo, void *hi)
+{
+    ss_lo = (uint64_t) lo;
+    ss_hi = (uint64_t) hi;
+    ss_count = 0;
+    ss_armed = 1;
+}
+
+void ss_disarm(void)
+{
+    ss_armed = 0;
+}
+
+int ss_start(void)
+{
+    ucontext_t *uc = pf_fault_context();
+
+    if (!uc || !ss_armed)
+        return -1;
+
+    ss_prev_rip = uc->uc_mcontext.gregs[REG_RIP];
+    if (SS_IN_RANGE(ss_prev_rip))
+        uc->uc_mcontext.gregs[REG_EFL] |= SS_TF;
+    return 0;
+}
+
+uint64_t ss_steps(void)
+{
+    return ss_count;
+}
+
+uint64_t ss_reset(void)
+{
+    uint64_t n = ss_count;
+
+    ss_count = 0;
+    return n;
+}
@@ -0,0 +1,43 @@
+#ifndef SS_H_INC
+#define SS_H_INC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Single-stepping with the x86 trap flag (EFLAGS.TF): while it is set, the
+ * CPU raises a debug exception (SIGTRAP) after every instruction.
+ *
+ * Stepping is confined to an armed address range [lo, hi): it is switched on
+ * from a page-fault callback (ss_start(), which sets TF in the context the
+ * faulting thread resumes with, see pf_fault_context()), and the SIGTRAP
+ * handler switches it off again as soon as execution leaves the range. Keep
+ * the range's pages protected (e.g., with pt.h) so that every entry into the
+ * range faults; the rest of the process then runs at full speed.
+ *
+ * The handler only counts the instructions executed inside the range, so
+ * ss_reset() from the fault callback yields the number of instructions that
+ * ran between two consecutive page faults.
+ */
+#define SS_TF               0x100
+
+/* Install the SIGTRAP handler. */
+void ss_init(void);
+
+/* Count instructions in [lo, hi) from the next ss_start() on. */
+void ss_arm(void *lo, void *hi);
+void ss_disarm(void);
+
+/*
+ * Switch stepping on for the faulting thread; only valid from a fault
+ * handler callback. Returns 0 on success.
+ */
+int ss_start(void);
+
+/* Instructions stepped inside the range since the last reset. */
+uint64_t ss_steps(void);
+/* Return ss_steps() and restart counting. */
+uint64_t ss_reset(void);
+
+#endif
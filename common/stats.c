@@ -0,0 +1,167 @@
+#include "debug.h"
+#include "stats.h"
+#include <string.h>
+
+void stats_moments_init(stats_moments_t *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+void stats_moments_add(stats_moments_t *m, double x)
+{
+    double delta = x - m->mean;
+
+    if (!m->n || x < m->min)
+        m->min = x;
+    if (!m->n || x > m->max)
+        m->max = x;
+
+    m->n++;
+    m->mean += delta / m->n;
+    m->m2 += delta * (x - m->mean);
+}
+
+double stats_variance(stats_moments_t *m)
+{
+    return (m->n > 1) ? m->m2 / (m->n - 1) : 0.0;
+}
+
+void stats_quantile_init(stats_quantile_t *q, double p)
+{
+    int i;
+
+    memset(q, 0, sizeof(*q));
+    q->p = p;
+
+    for (i=0; i < 5; i++)
+        q->n[i] = i;
+    q->want[0] = 0;
+    q->want[1] = 2*p;
+    q->want[2] = 4*p;
+    q->want[3] = 2 + 2*p;
+    q->want[4] = 4;
+    q->dwant[0] = 0;
+    q->dwant[1] = p/2;
+    q->dwant[2] = p;
+    q->dwant[3] = (1+p)/2;
+    q->dwant[4] = 1;
+}
+
+static double p2_parabolic(stats_quantile_t *q, int i, double d)
+{
+    return q->q[i] + d / (q->n[i+1] - q->n[i-1]) *
+        ((q->n[i] - q->n[i-1] + d) * (q->q[i+1] - q->q[i]) / (q->n[i+1] - q->n[i]) +
+         (q->n[i+1] - q->n[i] - d) * (q->q[i] - q->q[i-1]) / (q->n[i] - q->n[i-1]));
+}
+
+static double p2_linear(stats_quantile_t *q, int i, int d)
+{
+    return q->q[i] + d * (q->q[i+d] - q->q[i]) / (q->n[i+d] - q->n[i]);
+}
+
+void stats_quantile_add(stats_quantile_t *q, double x)
+{
+    double d, h;
+    int i, k;
+
+    /* the first five samples initialize the (sorted) markers */
+    if (q->count < 5)
+    {
+        for (i=q->count; i > 0 && q->q[i-1] > x; i--)
+            q->q[i] = q->q[i-1];
+        q->q[i] = x;
+        q->count++;
+        return;
+    }
+    q->count++;
+
+    /* find the cell k with q[k] <= x < q[k+1], extending the extremes */
+    if (x < q->q[0])
+    {
+        q->q[0] = x;
+        k = 0;
+    }
+    else if (x >= q->q[4])
+    {
+        q->q[4] = x;
+        k = 3;
+    }
+    else
+        for (k=0; x >= q->q[k+1]; k++);
+
+    for (i=k+1; i < 5; i++)
+        q->n[i]++;
+    for (i=0; i < 5; i++)
+        q->want[i] += q->dwant[i];
+
+    /* move the middle markers towards their desired positions */
+    for (i=1; i < 4; i++)
+    {
+        d = q->want[i] - q->n[i];
+        if ((d >= 1 && q->n[i+1] - q->n[i] > 1) ||
+            (d <= -1 && q->n[i-1] - q->n[i] < -1))
+        {
+            d = (d > 0) ? 1 : -1;
+            h = p2_parabolic(q, i, d);
+            if (q->q[i-1] < h && h < q->q[i+1])
+                q->q[i] = h;
+            else
+                q->q[i] = p2_linear(q, i, (int) d);
+            q->n[i] += d;
+        }
+    }
+}
+
+double stats_quantile_get(stats_quantile_t *q)
+{
+    int i;
+
+    if (!q->count)
+        return 0.0;
+
+    /* exact for the first few samples, which are kept sorted */
+    if (q->count <= 5)
+    {
+        i = (int) (q->p * (q->count-1) + 0.5);
+        return q->q[i];
+    }
+
+    return q->q[2];
+}
+
+void stats_hist_init(stats_hist_t *h, double lo, double hi)
+{
+    ASSERT(hi > lo);
+    memset(h, 0, sizeof(*h));
+    h->lo = lo;
+    h->width = (hi - lo) / STATS_HIST_BINS;
+}
+
+void stats_hist_add(stats_hist_t *h, double x)
+{
+    double b = (x - h->lo) / h->width;
+
+    /* anything that is not a valid bin index (e.g., NaN) counts as over */
+    h->total++;
+    if (b < 0)
+        h->under++;
+    else if (b < STATS_HIST_BINS)
+        h->bin[(int) b]++;
+    else
+        h->over++;
+}
+
+double stats_hist_quantile(stats_hist_t *h, double p)
+{
+    uint64_t sum = h->under;
+    int i;
+
+    if (sum > p * h->total)
+        return h->lo;
+
+    for (i=0; i < STATS_HIST_BINS; i++)
+        if ((sum += h->bin[i]) > p * h->total)
+            return h->lo + i * h->width;
+
+    return h->lo + STATS_HIST_BINS * h->width;
+}
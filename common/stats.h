@@ -0,0 +1,63 @@
+#ifndef STATS_H_INC
+#define STATS_H_INC
+
+#include <stdint.h>
+
+/*
+ * Constant-memory streaming statistics: every *_add() is O(1), so timing
+ * loops no longer need to store all samples and sort them afterwards.
+ */
+
+/* Running mean and variance (Welford), plus min and max. */
+typedef struct {
+    uint64_t n;
+    double mean;
+    double m2;
+    double min;
+    double max;
+} stats_moments_t;
+
+void stats_moments_init(stats_moments_t *m);
+void stats_moments_add(stats_moments_t *m, double x);
+double stats_variance(stats_moments_t *m);
+
+/*
+ * Estimate of the p-quantile (e.g., p=0.5 for the median) with the P²
+ * algorithm (Jain and Chlamtac, CACM 1985): five markers whose heights are
+ * adjusted with a piecewise-parabolic fit as samples arrive.
+ */
+typedef struct {
+    double p;
+    uint64_t count;
+    double q[5];        /* marker heights */
+    double n[5];        /* actual marker positions */
+    double want[5];     /* desired marker positions */
+    double dwant[5];    /* increments of the desired positions */
+} stats_quantile_t;
+
+void stats_quantile_init(stats_quantile_t *q, double p);
+void stats_quantile_add(stats_quantile_t *q, double x);
+double stats_quantile_get(stats_quantile_t *q);
+
+/*
+ * Histogram of STATS_HIST_BINS buckets of equal width starting at 'lo';
+ * samples outside the range are counted in 'under' and 'over'.
+ */
+#define STATS_HIST_BINS     256
+
+typedef struct {
+    double lo;
+    double width;
+    uint64_t total;
+    uint64_t under;
+    uint64_t over;
+    uint64_t bin[STATS_HIST_BINS];
+} stats_hist_t;
+
+/* Bins [lo, hi) into STATS_HIST_BINS buckets; hi must be above lo. */
+void stats_hist_init(stats_hist_t *h, double lo, double hi);
+void stats_hist_add(stats_hist_t *h, double x);
+/* Lower bound of the bucket holding the p-quantile (O(STATS_HIST_BINS)). */
+double stats_hist_quantile(stats_hist_t *h, double p);
+
+#endif
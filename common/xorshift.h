@@ -0,0 +1,27 @@
+#ifndef XORSHIFT_H_INC
+#define XORSHIFT_H_INC
+
+#include <stdint.h>
+
+/*
+ * Marsaglia's xorshift64: a fast, non-cryptographic PRNG for shuffling probe
+ * orders and layouts. The state must never be 0; seed it with
+ * xorshift_seed() (the TSC) for a different sequence every run.
+ */
+static inline uint64_t xorshift_seed(void)
+{
+    uint32_t a, d;
+
+    asm volatile ("rdtsc\n\t" : "=a" (a), "=d" (d));
+    return (((uint64_t) d << 32) | a) | 1;
+}
+
+static inline uint64_t xorshift(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+#endif